@@ -0,0 +1,235 @@
+// Performance regression harness for the simulator binary.
+//
+//   node bench/bench.js [--binary ./pipeline_web] [--tiers small,medium]
+//                       [--repeat 5] [--threshold 10] [--update-baseline]
+//
+// Every trace of the selected tiers is run `repeat` times. The run records
+// the median wall time, throughput (simulated cycles/s and instructions/s),
+// peak RSS and output bytes, appends them to bench/history.json and
+// compares them with bench/baseline.json. A trace regresses when its
+// throughput drops by more than `threshold` percent and by more than
+// three times the run-to-run spread (median absolute deviation) of either
+// run, so a noisy machine does not raise false alarms. Output size and
+// peak RSS are flagged when they grow by more than `threshold` percent.
+// Traces with an `expectCycles` are also correctness checks: a different
+// simulated cycle count fails the run whatever the baseline says.
+// Exits with status 1 on any regression or failed check.
+//
+// --update-baseline skips the comparison and instead writes this run's
+// results into bench/baseline.json (traces not run keep their entry).
+// Record a baseline on the machine you benchmark on before comparing:
+// wall times do not transfer between machines, so neither
+// bench/baseline.json nor bench/history.json is committed.
+//
+// Tiers: "small" (the sample traces and short kernels), "medium" (the
+// vector kernel, about 26 MB of output and seconds per run, and 100K
+// synthetic instructions) and "large" (10M, several GB of memory). The
+// synthetic tiers stop at a cycle cap, so they measure per-cycle cost on
+// a large trace rather than a complete run.
+
+const { execSync } = require('child_process');
+const fs = require('fs');
+const path = require('path');
+const { syntheticTrace, runOnce, median } = require('./common');
+
+const BENCH_DIR = __dirname;
+const HISTORY_PATH = path.join(BENCH_DIR, 'history.json');
+const BASELINE_PATH = path.join(BENCH_DIR, 'baseline.json');
+const SAMPLES_DIR = path.join(BENCH_DIR, '..', '..', 'frontend', 'public');
+
+function parseArgs(argv) {
+  const options = {
+    binary: path.join(BENCH_DIR, '..', 'pipeline_web'),
+    tiers: ['small', 'medium'],
+    repeat: 5,
+    threshold: 10,
+    updateBaseline: false,
+  };
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if (arg === '--binary') options.binary = path.resolve(argv[++i]);
+    else if (arg === '--tiers') options.tiers = argv[++i].split(',');
+    else if (arg === '--repeat') options.repeat = Math.max(1, parseInt(argv[++i], 10));
+    else if (arg === '--threshold') options.threshold = Math.max(0, parseFloat(argv[++i]));
+    else if (arg === '--update-baseline') options.updateBaseline = true;
+    else throw new Error(`Unknown option ${arg}`);
+  }
+  return options;
+}
+
+// --- Corpus ---
+
+function readSample(name) {
+  return fs.readFileSync(path.join(SAMPLES_DIR, name), 'utf-8')
+    .split('\n')
+    .map(line => line.trim())
+    .filter(line => line.length > 0 && !line.startsWith('#'));
+}
+
+function repeatBody(body, times) {
+  const trace = [];
+  for (let i = 0; i < times; i++) trace.push(...body);
+  return trace;
+}
+
+const LOOP_BODY = ['LOAD R1 R2', 'ADD R3 R1 R4', 'MUL R5 R3 R3', 'SUB R6 R5 R1',
+                   'FADD R7 R8 R9', 'ADD R2 R2 R10', 'BNE R2 R0 1 T'];
+const VECTOR_BODY = ['VLOAD V1 R1 0x1000', 'VLOAD V2 R1 0x1020', 'VMUL V3 V1 V2',
+                     'VADD V4 V3 V1', 'VSTORE V4 R1 0x2000', 'ADD R1 R1 R2'];
+
+function corpus(tiers) {
+  const traces = [];
+  if (tiers.includes('small')) {
+    traces.push({ name: 'sample-instructions', instructions: readSample('instructions.txt') });
+    traces.push({ name: 'sample-t1', instructions: readSample('t1.txt') });
+    traces.push({ name: 'kernel-dependency-chain', instructions: repeatBody(['ADD R1 R1 R2'], 200),
+                  config: { maxCycles: 100000 } });
+    traces.push({ name: 'kernel-loop', instructions: repeatBody(LOOP_BODY, 150),
+                  config: { frontEnd: {}, maxCycles: 100000 } });
+    traces.push({ name: 'kernel-memory', instructions: syntheticTrace(500, { seed: 7 }),
+                  config: { frontEnd: {}, dcache: {}, dram: {}, maxCycles: 100000 } });
+    traces.push({ name: 'synthetic-1k', instructions: syntheticTrace(1000),
+                  config: { frontEnd: {}, maxCycles: 100000 } });
+    // Vector chaining must follow the producer's actual latency: an
+    // overridden one, and a VLOAD that misses in the data cache.
+    traces.push({ name: 'chain-latency-override', instructions: ['VADD V1 V2 V3', 'VADD V4 V1 V5'],
+                  config: { latencies: { VADD: 40 }, units: { VEC: 2 } }, expectCycles: 86 });
+    traces.push({ name: 'chain-vload-miss', instructions: ['VLOAD V1 R1 0x40000', 'VADD V2 V1 V3'],
+                  config: { dcache: {}, units: { VEC: 2 } }, expectCycles: 33 });
+  }
+  if (tiers.includes('medium')) {
+    traces.push({ name: 'kernel-vector', instructions: repeatBody(VECTOR_BODY, 50),
+                  config: { maxCycles: 100000 } });
+    traces.push({ name: 'synthetic-100k', instructions: syntheticTrace(100000),
+                  config: { frontEnd: {}, maxCycles: 500 } });
+  }
+  if (tiers.includes('large')) {
+    traces.push({ name: 'synthetic-10m', instructions: syntheticTrace(10000000),
+                  config: { frontEnd: {}, maxCycles: 100 } });
+  }
+  return traces;
+}
+
+// --- Measurement ---
+
+async function measure(binary, trace, repeat) {
+  const payload = JSON.stringify({ instructions: trace.instructions, config: trace.config || {} });
+  const runs = [];
+  for (let r = 0; r < repeat; r++) {
+    const { result, ...run } = await runOnce(binary, payload);
+    runs.push({ ...run, cycles: result.stats.totalCycles, instructions: result.stats.instructionsCompleted });
+  }
+  const walls = runs.map(run => run.wallMs);
+  const wallMs = median(walls);
+  const mad = median(walls.map(w => Math.abs(w - wallMs)));
+  const first = runs[0];
+  const rss = runs.map(run => run.peakRssKb).filter(v => v !== null);
+  return {
+    traceInstructions: trace.instructions.length,
+    cycles: first.cycles,
+    instructions: first.instructions,
+    wallMs,
+    wallMadMs: mad,
+    cyclesPerSec: first.cycles / (wallMs / 1000),
+    instructionsPerSec: first.instructions / (wallMs / 1000),
+    peakRssKb: rss.length ? Math.max(...rss) : null,
+    outputBytes: first.outputBytes,
+  };
+}
+
+// --- Baseline comparison ---
+
+function compare(current, baseline, threshold) {
+  const findings = [];
+  for (const [name, cur] of Object.entries(current)) {
+    const base = baseline[name];
+    if (!base) continue;
+    const slowdown = 100 * (base.cyclesPerSec - cur.cyclesPerSec) / base.cyclesPerSec;
+    const noise = 100 * 3 * Math.max(base.wallMadMs / base.wallMs, cur.wallMadMs / cur.wallMs);
+    if (slowdown > threshold && slowdown > noise) {
+      findings.push(`${name}: throughput down ${slowdown.toFixed(1)}% (noise band ${noise.toFixed(1)}%)`);
+    }
+    const grew = (key, label) => {
+      if (base[key] == null || cur[key] == null || base[key] === 0) return;
+      const growth = 100 * (cur[key] - base[key]) / base[key];
+      if (growth > threshold) findings.push(`${name}: ${label} up ${growth.toFixed(1)}%`);
+    };
+    grew('outputBytes', 'output bytes');
+    grew('peakRssKb', 'peak RSS');
+    if (cur.cycles !== base.cycles) {
+      findings.push(`${name}: simulated cycles changed ${base.cycles} -> ${cur.cycles} (results differ)`);
+    }
+  }
+  return findings;
+}
+
+function readJson(file, fallback) {
+  return fs.existsSync(file) ? JSON.parse(fs.readFileSync(file, 'utf-8')) : fallback;
+}
+
+function gitCommit() {
+  try {
+    return execSync('git rev-parse --short HEAD', { cwd: BENCH_DIR, stdio: ['ignore', 'pipe', 'ignore'] })
+      .toString().trim();
+  } catch (err) {
+    return null;
+  }
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  if (!fs.existsSync(options.binary)) {
+    console.error(`Simulator binary not found at ${options.binary}; build it or pass --binary.`);
+    process.exit(2);
+  }
+
+  const results = {};
+  const failures = [];
+  for (const trace of corpus(options.tiers)) {
+    const result = await measure(options.binary, trace, options.repeat);
+    results[trace.name] = result;
+    if (trace.expectCycles !== undefined && result.cycles !== trace.expectCycles) {
+      failures.push(`${trace.name}: simulated ${result.cycles} cycles, expected ${trace.expectCycles}`);
+    }
+    console.log(`${trace.name.padEnd(24)} ${result.wallMs.toFixed(1).padStart(10)} ms` +
+                `  ${Math.round(result.cyclesPerSec).toString().padStart(10)} cycles/s` +
+                `  ${Math.round(result.instructionsPerSec).toString().padStart(10)} instr/s` +
+                `  ${String(result.peakRssKb ?? '-').padStart(8)} kB` +
+                `  ${result.outputBytes.toString().padStart(10)} B`);
+  }
+
+  const entry = { timestamp: new Date().toISOString(), commit: gitCommit(), repeat: options.repeat, results };
+  const history = readJson(HISTORY_PATH, []);
+  history.push(entry);
+  fs.writeFileSync(HISTORY_PATH, JSON.stringify(history, null, 2));
+
+  if (failures.length > 0) {
+    console.log('Failed checks:');
+    for (const failure of failures) console.log(`  ${failure}`);
+    process.exit(1);
+  }
+  if (options.updateBaseline) {
+    const baseline = readJson(BASELINE_PATH, {});
+    Object.assign(baseline, results);
+    fs.writeFileSync(BASELINE_PATH, JSON.stringify(baseline, null, 2));
+    console.log(`Baseline updated (${Object.keys(results).length} traces).`);
+    return;
+  }
+  if (!fs.existsSync(BASELINE_PATH)) {
+    console.log('No baseline yet; run with --update-baseline to record one.');
+    return;
+  }
+  const findings = compare(results, readJson(BASELINE_PATH, {}), options.threshold);
+  if (findings.length === 0) {
+    console.log(`No regressions against the baseline (threshold ${options.threshold}%).`);
+    return;
+  }
+  console.log('Regressions:');
+  for (const finding of findings) console.log(`  ${finding}`);
+  process.exit(1);
+}
+
+main().catch((err) => {
+  console.error(err.message);
+  process.exit(2);
+});
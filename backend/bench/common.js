@@ -0,0 +1,89 @@
+// Helpers shared by the benchmark scripts: the synthetic trace
+// generator, one timed simulator run and the median.
+
+const { spawn } = require('child_process');
+const fs = require('fs');
+
+// Deterministic mix of ALU, FP, memory and branch ops with short
+// dependency distances; `seed` fixes the trace for a given size. With
+// `branches: false` the branch slots become ALU ops, so every size runs
+// the same machine.
+function syntheticTrace(size, { seed = 1, branches = true } = {}) {
+  let state = seed >>> 0;
+  const next = (n) => {
+    state = (Math.imul(state, 1664525) + 1013904223) >>> 0;
+    return state % n;
+  };
+  const reg = () => `R${1 + next(15)}`;
+  const trace = [];
+  let address = 0x1000;
+  for (let i = 0; i < size; i++) {
+    const kind = next(100);
+    if (kind < 35) trace.push(`${['ADD', 'SUB', 'MUL'][next(3)]} ${reg()} ${reg()} ${reg()}`);
+    else if (kind < 50) trace.push(`${['FADD', 'FMUL'][next(2)]} ${reg()} ${reg()} ${reg()}`);
+    else if (kind < 65) trace.push(`LOAD ${reg()} ${reg()} 0x${(address += 8).toString(16)}`);
+    else if (kind < 75) trace.push(`STORE ${reg()} ${reg()} 0x${(address += 8).toString(16)}`);
+    else if (kind < 85 && branches) trace.push(`BNE ${reg()} R0 ${Math.max(1, i + 1 - next(8))} ${next(4) ? 'T' : 'N'}`);
+    else if (kind < 85) trace.push(`ADD ${reg()} ${reg()} ${reg()}`);
+    else if (kind < 88) trace.push(`DIV ${reg()} ${reg()} ${reg()}`);
+    else trace.push(`ADD ${reg()} ${reg()} R0`);
+  }
+  return trace;
+}
+
+// Peak RSS is sampled from /proc (Linux only); null elsewhere.
+function readPeakRssKb(pid) {
+  try {
+    const status = fs.readFileSync(`/proc/${pid}/status`, 'utf-8');
+    const match = status.match(/VmHWM:\s+(\d+)\s+kB/);
+    return match ? parseInt(match[1], 10) : null;
+  } catch (err) {
+    return null;
+  }
+}
+
+// Runs the simulator once on a JSON `payload` string and resolves with
+// its wall time, peak RSS, output size and parsed "result" object.
+function runOnce(binary, payload) {
+  return new Promise((resolve, reject) => {
+    const start = process.hrtime.bigint();
+    const sim = spawn(binary);
+    let peakRssKb = null;
+    const poll = setInterval(() => {
+      const rss = readPeakRssKb(sim.pid);
+      if (rss !== null) peakRssKb = Math.max(peakRssKb || 0, rss);
+    }, 5);
+    const chunks = [];
+    let outputBytes = 0;
+    sim.stdout.on('data', (data) => {
+      chunks.push(data);
+      outputBytes += data.length;
+    });
+    sim.on('error', (err) => {
+      clearInterval(poll);
+      reject(err);
+    });
+    sim.on('close', (code) => {
+      clearInterval(poll);
+      const wallMs = Number(process.hrtime.bigint() - start) / 1e6;
+      if (code !== 0) return reject(new Error(`simulator exited with code ${code}`));
+      let result;
+      try {
+        result = JSON.parse(Buffer.concat(chunks).toString()).result;
+      } catch (err) {
+        return reject(new Error('could not parse simulator output'));
+      }
+      resolve({ wallMs, peakRssKb, outputBytes, result });
+    });
+    sim.stdin.on('error', () => {}); // The simulator may exit before reading everything
+    sim.stdin.end(payload);
+  });
+}
+
+function median(values) {
+  const sorted = [...values].sort((a, b) => a - b);
+  const mid = Math.floor(sorted.length / 2);
+  return sorted.length % 2 ? sorted[mid] : (sorted[mid - 1] + sorted[mid]) / 2;
+}
+
+module.exports = { syntheticTrace, runOnce, median };
@@ -0,0 +1,252 @@
+// End-to-end load generator for server.js + pipeline_web.
+//
+//   node bench/load.js [--url http://localhost:3001] [--spawn]
+//                      [--duration 30] [--concurrency 8]
+//                      [--mix simulate=70,upload=20,generate=10]
+//                      [--sizes 10,100,1000] [--server-pid PID] [--json]
+//
+// `concurrency` workers issue requests back to back for `duration`
+// seconds, each picking an endpoint by the weights in `mix` and, for
+// /api/simulate and /api/upload-file, a trace length from `sizes`. The
+// report gives throughput, latency percentiles and error rates per
+// endpoint. Server CPU (in cores, including the simulator processes it
+// has reaped) and RSS (server plus live simulator children) are sampled
+// from /proc on Linux: pass --server-pid for a running server, or
+// --spawn to start server.js from this directory for the run.
+
+const { spawn } = require('child_process');
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+const { syntheticTrace } = require('./common');
+
+function parseArgs(argv) {
+  const options = {
+    url: 'http://localhost:3001',
+    spawn: false,
+    duration: 30,
+    concurrency: 8,
+    mix: { simulate: 70, upload: 20, generate: 10 },
+    sizes: [10, 100, 1000],
+    serverPid: null,
+    json: false,
+  };
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if (arg === '--url') options.url = argv[++i];
+    else if (arg === '--spawn') options.spawn = true;
+    else if (arg === '--duration') options.duration = Math.max(1, parseFloat(argv[++i]));
+    else if (arg === '--concurrency') options.concurrency = Math.max(1, parseInt(argv[++i], 10));
+    else if (arg === '--sizes') options.sizes = argv[++i].split(',').map(n => Math.max(1, parseInt(n, 10)));
+    else if (arg === '--server-pid') options.serverPid = parseInt(argv[++i], 10);
+    else if (arg === '--json') options.json = true;
+    else if (arg === '--mix') {
+      options.mix = {};
+      for (const part of argv[++i].split(',')) {
+        const [name, weight] = part.split('=');
+        if (!['simulate', 'upload', 'generate'].includes(name)) throw new Error(`Unknown endpoint ${name}`);
+        options.mix[name] = Math.max(0, parseFloat(weight));
+      }
+    } else {
+      throw new Error(`Unknown option ${arg}`);
+    }
+  }
+  return options;
+}
+
+// --- Requests ---
+
+// A fresh seed per request, so the server sees varied traces.
+function randomTrace(size) {
+  return syntheticTrace(size, { seed: Math.floor(Math.random() * 0x100000000) });
+}
+
+function pick(weights) {
+  const total = Object.values(weights).reduce((a, b) => a + b, 0);
+  let r = Math.random() * total;
+  for (const [name, weight] of Object.entries(weights)) {
+    if ((r -= weight) < 0) return name;
+  }
+  return Object.keys(weights)[0];
+}
+
+async function issue(url, endpoint, size) {
+  if (endpoint === 'simulate') {
+    return fetch(`${url}/api/simulate`, {
+      method: 'POST',
+      headers: { 'Content-Type': 'application/json' },
+      body: JSON.stringify({ instructions: randomTrace(size) }),
+    });
+  }
+  if (endpoint === 'upload') {
+    const form = new FormData();
+    form.append('file', new Blob([randomTrace(size).join('\n')], { type: 'text/plain' }), 'trace.txt');
+    return fetch(`${url}/api/upload-file`, { method: 'POST', body: form });
+  }
+  return fetch(`${url}/api/generate-instructions`, {
+    method: 'POST',
+    headers: { 'Content-Type': 'application/json' },
+    body: JSON.stringify({ count: size }),
+  });
+}
+
+// --- Server sampling (Linux /proc) ---
+
+const CLOCK_TICKS = 100; // USER_HZ on Linux
+
+function readStat(pid) {
+  try {
+    const stat = fs.readFileSync(`/proc/${pid}/stat`, 'utf-8');
+    const fields = stat.slice(stat.lastIndexOf(')') + 2).split(' ');
+    // utime, stime, cutime, cstime are fields 14-17 of the full line.
+    return fields.slice(11, 15).reduce((sum, v) => sum + parseInt(v, 10), 0);
+  } catch (err) {
+    return null;
+  }
+}
+
+function readRssKb(pid) {
+  try {
+    const match = fs.readFileSync(`/proc/${pid}/status`, 'utf-8').match(/VmRSS:\s+(\d+)\s+kB/);
+    return match ? parseInt(match[1], 10) : 0;
+  } catch (err) {
+    return 0;
+  }
+}
+
+function childPids(pid) {
+  try {
+    return fs.readdirSync(`/proc/${pid}/task`).flatMap(tid => fs
+      .readFileSync(`/proc/${pid}/task/${tid}/children`, 'utf-8').trim().split(/\s+/).filter(Boolean));
+  } catch (err) {
+    return [];
+  }
+}
+
+class ServerSampler {
+  constructor(pid) {
+    this.pid = pid;
+    this.rssSamples = [];
+    this.startTicks = readStat(pid);
+    this.startTime = Date.now();
+    this.timer = setInterval(() => {
+      const rss = readRssKb(pid) + childPids(pid).reduce((sum, child) => sum + readRssKb(child), 0);
+      if (rss > 0) this.rssSamples.push(rss);
+    }, 50);
+  }
+  stop() {
+    clearInterval(this.timer);
+    const ticks = readStat(this.pid);
+    const seconds = (Date.now() - this.startTime) / 1000;
+    if (ticks === null || this.startTicks === null) return null;
+    const rss = this.rssSamples;
+    return {
+      cpuCores: (ticks - this.startTicks) / CLOCK_TICKS / seconds,
+      rssPeakKb: rss.length ? Math.max(...rss) : null,
+      rssMeanKb: rss.length ? Math.round(rss.reduce((a, b) => a + b, 0) / rss.length) : null,
+    };
+  }
+}
+
+async function startServer(url) {
+  const server = spawn('node', ['server.js'], { cwd: path.join(__dirname, '..'), stdio: 'ignore' });
+  for (let attempt = 0; attempt < 50; attempt++) {
+    await new Promise(resolve => setTimeout(resolve, 100));
+    try {
+      await fetch(`${url}/api/generate-instructions`, { method: 'POST' });
+      return server;
+    } catch (err) {
+      // Not listening yet
+    }
+  }
+  server.kill();
+  throw new Error('server.js did not start listening');
+}
+
+// --- Report ---
+
+function percentile(sorted, p) {
+  if (sorted.length === 0) return null;
+  return sorted[Math.min(sorted.length - 1, Math.floor(p / 100 * sorted.length))];
+}
+
+function summarize(samples, seconds) {
+  const latencies = samples.map(s => s.ms).sort((a, b) => a - b);
+  const errors = samples.filter(s => !s.ok).length;
+  return {
+    requests: samples.length,
+    throughput: samples.length / seconds,
+    errors,
+    errorRate: samples.length ? errors / samples.length : 0,
+    latencyMs: {
+      p50: percentile(latencies, 50),
+      p90: percentile(latencies, 90),
+      p99: percentile(latencies, 99),
+      max: latencies.length ? latencies[latencies.length - 1] : null,
+    },
+  };
+}
+
+function printReport(report) {
+  const fmt = (v, digits = 1) => (v === null || v === undefined) ? '-' : v.toFixed(digits);
+  console.log(`${report.concurrency} workers for ${fmt(report.seconds)} s against ${report.url}`);
+  console.log('endpoint      requests    req/s   errors      p50      p90      p99      max (ms)');
+  for (const [name, s] of Object.entries(report.endpoints)) {
+    console.log(`${name.padEnd(12)}${String(s.requests).padStart(10)}${fmt(s.throughput).padStart(9)}` +
+                `${(fmt(100 * s.errorRate) + '%').padStart(9)}${fmt(s.latencyMs.p50).padStart(9)}` +
+                `${fmt(s.latencyMs.p90).padStart(9)}${fmt(s.latencyMs.p99).padStart(9)}${fmt(s.latencyMs.max).padStart(9)}`);
+  }
+  if (report.server) {
+    console.log(`server: ${fmt(report.server.cpuCores, 2)} cores of ${os.cpus().length}, ` +
+                `RSS peak ${report.server.rssPeakKb ?? '-'} kB, mean ${report.server.rssMeanKb ?? '-'} kB`);
+  }
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  const server = options.spawn ? await startServer(options.url) : null;
+  const pid = server ? server.pid : options.serverPid;
+  const sampler = pid ? new ServerSampler(pid) : null;
+
+  const samples = [];
+  const deadline = Date.now() + options.duration * 1000;
+  const start = Date.now();
+  const worker = async () => {
+    while (Date.now() < deadline) {
+      const endpoint = pick(options.mix);
+      const size = options.sizes[Math.floor(Math.random() * options.sizes.length)];
+      const t0 = process.hrtime.bigint();
+      let ok = false;
+      try {
+        const res = await issue(options.url, endpoint, size);
+        await res.arrayBuffer();
+        ok = res.ok;
+      } catch (err) {
+        ok = false;
+      }
+      samples.push({ endpoint, size, ok, ms: Number(process.hrtime.bigint() - t0) / 1e6 });
+    }
+  };
+  await Promise.all(Array.from({ length: options.concurrency }, worker));
+  const seconds = (Date.now() - start) / 1000;
+
+  const report = { url: options.url, concurrency: options.concurrency, seconds, endpoints: {} };
+  report.endpoints.all = summarize(samples, seconds);
+  for (const name of Object.keys(options.mix)) {
+    report.endpoints[name] = summarize(samples.filter(s => s.endpoint === name), seconds);
+  }
+  for (const size of options.sizes) {
+    report.endpoints[`simulate/${size}`] =
+      summarize(samples.filter(s => s.endpoint === 'simulate' && s.size === size), seconds);
+  }
+  if (sampler) report.server = sampler.stop();
+  if (server) server.kill();
+
+  if (options.json) console.log(JSON.stringify(report, null, 2));
+  else printReport(report);
+}
+
+main().catch((err) => {
+  console.error(err.message);
+  process.exit(1);
+});
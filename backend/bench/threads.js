@@ -0,0 +1,163 @@
+// Thread-scaling benchmark for the simulator binary.
+//
+//   node bench/threads.js [--binary ./pipeline_web] [--threads 1,2,4,8]
+//                         [--sizes 500,2000,8000] [--batch-runs 32]
+//                         [--repeat 3] [--json]
+//
+// Runs two workloads at every team size (config "threads"):
+//   single  one simulation of a synthetic trace per size, capped at
+//           100 cycles so each size measures the per-cycle cost of the
+//           stages' parallel loops over that many instructions;
+//   batch   an interpreted latency sweep of `batch-runs` runs on a short
+//           trace, which spreads whole runs over the team.
+// For each it reports the median wall time, speedup and parallel
+// efficiency against one thread. One extra single-run simulation per
+// size is made with "profileThreads" to split the time into serial
+// code, work inside parallel regions, waiting at their closing barriers
+// and the ExecUnitRelease critical section. The recommended count is
+// the smallest one within 5% of the best geometric-mean time over all
+// workloads; pass it to the binary as config "threads" or through the
+// PIPELINE_THREADS environment variable.
+
+const os = require('os');
+const path = require('path');
+const { syntheticTrace, runOnce, median } = require('./common');
+
+function parseArgs(argv) {
+  const cpus = os.cpus().length;
+  const threads = [];
+  for (let t = 1; t < cpus; t *= 2) threads.push(t);
+  threads.push(cpus);
+  const options = {
+    binary: path.join(__dirname, '..', 'pipeline_web'),
+    threads,
+    sizes: [500, 2000, 8000],
+    batchRuns: 32,
+    repeat: 3,
+    json: false,
+  };
+  for (let i = 0; i < argv.length; i++) {
+    const arg = argv[i];
+    if (arg === '--binary') options.binary = path.resolve(argv[++i]);
+    else if (arg === '--threads') options.threads = argv[++i].split(',').map(n => Math.max(1, parseInt(n, 10)));
+    else if (arg === '--sizes') options.sizes = argv[++i].split(',').map(n => Math.max(1, parseInt(n, 10)));
+    else if (arg === '--batch-runs') options.batchRuns = Math.max(1, parseInt(argv[++i], 10));
+    else if (arg === '--repeat') options.repeat = Math.max(1, parseInt(argv[++i], 10));
+    else if (arg === '--json') options.json = true;
+    else throw new Error(`Unknown option ${arg}`);
+  }
+  if (!options.threads.includes(1)) options.threads.unshift(1); // Speedups are relative to one thread
+  options.threads = [...new Set(options.threads)].sort((a, b) => a - b);
+  return options;
+}
+
+function workloads(options) {
+  const list = options.sizes.map(size => ({
+    name: `single-${size}`,
+    mode: 'single',
+    input: { instructions: syntheticTrace(size, { branches: false }), config: { maxCycles: 100 } },
+  }));
+  list.push({
+    name: `batch-${options.batchRuns}`,
+    mode: 'batch',
+    input: {
+      instructions: syntheticTrace(200, { seed: 3, branches: false }),
+      config: { maxCycles: 100000 },
+      mode: 'sweep',
+      sweep: { runs: options.batchRuns, jit: false, latencies: { LOAD: [2, 8], MUL: [2, 4] } },
+    },
+  });
+  return list;
+}
+
+// --- Measurement ---
+
+function withThreads(input, threads, extra = {}) {
+  return { ...input, config: { ...input.config, threads, ...extra } };
+}
+
+async function measure(binary, workload, threads, repeat) {
+  const walls = [];
+  for (let r = 0; r < repeat; r++) {
+    walls.push((await runOnce(binary, JSON.stringify(withThreads(workload.input, threads)))).wallMs);
+  }
+  const point = { threads, wallMs: median(walls) };
+  if (workload.mode === 'single') {
+    const { result } = await runOnce(binary, JSON.stringify(withThreads(workload.input, threads, { profileThreads: true })));
+    point.profile = result.stats.threadProfile;
+  }
+  return point;
+}
+
+// --- Report ---
+
+function geomean(values) {
+  return Math.exp(values.reduce((sum, v) => sum + Math.log(v), 0) / values.length);
+}
+
+function recommend(results, threads) {
+  // Each workload's times are normalised to its one-thread time, so
+  // long and short workloads weigh the same.
+  const scores = threads.map(t => geomean(results.map(w => {
+    const base = w.points[0].wallMs;
+    return w.points.find(p => p.threads === t).wallMs / base;
+  })));
+  const best = Math.min(...scores);
+  const index = scores.findIndex(score => score <= best * 1.05);
+  return { threads: threads[index], relativeTime: scores[index] };
+}
+
+function printReport(report) {
+  const fmt = (v, digits = 1) => (v === null || v === undefined) ? '-' : v.toFixed(digits);
+  console.log(`${report.host.cpus} CPUs (${report.host.model})`);
+  for (const w of report.workloads) {
+    console.log(`\n${w.name}`);
+    console.log('threads   wall (ms)  speedup  efficiency   serial  parallel   barrier  crit wait  crit hold (ms)');
+    for (const p of w.points) {
+      const prof = p.profile || {};
+      console.log(`${String(p.threads).padStart(7)}${fmt(p.wallMs).padStart(12)}${fmt(p.speedup, 2).padStart(9)}` +
+                  `${(fmt(100 * p.efficiency) + '%').padStart(12)}${fmt(prof.serialMs).padStart(9)}` +
+                  `${fmt(prof.parallelMs).padStart(10)}${fmt(prof.barrierMs).padStart(10)}` +
+                  `${fmt(prof.criticalWaitMs, 2).padStart(11)}${fmt(prof.criticalHoldMs, 2).padStart(11)}`);
+    }
+  }
+  const rec = report.recommendation;
+  console.log(`\nRecommended: ${rec.threads} thread(s), ${fmt(100 * rec.relativeTime)}% of the one-thread time ` +
+              `(single-run: ${report.recommendationByMode.single.threads}, ` +
+              `batch: ${report.recommendationByMode.batch.threads})`);
+  console.log(`Use config {"threads": ${rec.threads}} or PIPELINE_THREADS=${rec.threads}.`);
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  const results = [];
+  for (const workload of workloads(options)) {
+    const points = [];
+    for (const threads of options.threads) {
+      if (!options.json) process.stderr.write(`${workload.name} @ ${threads} thread(s)\n`);
+      points.push(await measure(options.binary, workload, threads, options.repeat));
+    }
+    for (const p of points) {
+      p.speedup = points[0].wallMs / p.wallMs;
+      p.efficiency = p.speedup / p.threads;
+    }
+    results.push({ name: workload.name, mode: workload.mode, points });
+  }
+
+  const report = {
+    host: { cpus: os.cpus().length, model: os.cpus()[0] ? os.cpus()[0].model : 'unknown' },
+    workloads: results,
+    recommendation: recommend(results, options.threads),
+    recommendationByMode: {
+      single: recommend(results.filter(w => w.mode === 'single'), options.threads),
+      batch: recommend(results.filter(w => w.mode === 'batch'), options.threads),
+    },
+  };
+  if (options.json) console.log(JSON.stringify(report, null, 2));
+  else printReport(report);
+}
+
+main().catch((err) => {
+  console.error(err.message);
+  process.exit(1);
+});
@@ -9,180 +9,1848 @@
  * Requires the nlohmann/json library:
  * Download `json.hpp` from https://github.com/nlohmann/json
  *
- * Compile: g++ -std=c++17 -fopenmp pipeline_web.cpp -o pipeline_web
+ * Compile: g++ -std=c++17 -fopenmp pipeline_fixed.cpp -o pipeline_web -ldl
+ * (-ldl is needed for the sweep kernel's dlopen on glibc before 2.34)
  */
 
 #include <iostream>
 #include <vector>
+#include <array>
 #include <string>
 #include <iomanip>
 #include <queue>
 #include <map>
+#include <unordered_map>
 #include <algorithm>
 #include <cmath>
 #include <fstream>
 #include <sstream>
+#include <cstdint>
+#include <memory>
+#include <deque>
+#include <climits>
+#include <chrono>
+#include <cfloat>
+#include <random>
+#include <cstdlib>
+#include <utility>
+#include <dlfcn.h>
+#include <unistd.h>
 #include <omp.h>
 #include "json.hpp" // Include the nlohmann/json header
 
 using namespace std;
 using json = nlohmann::json;
 
-// --- (All your enums and helper functions: Opcode, ExecUnit, getExecUnit, etc.) ---
-// --- (These are unchanged from your original file) ---
+// --- Opcodes, registers and pipeline stages ---
 
-enum Opcode { ADD, SUB, MUL, DIV, FADD, FMUL, FDIV, LOAD, STORE, BEQ, BNE, JMP, NOP };
-enum ExecUnit { ALU_UNIT, FPU_UNIT, MEM_UNIT, BRANCH_UNIT, ANY_UNIT };
+enum ExecUnit { ALU_UNIT, FPU_UNIT, MEM_UNIT, BRANCH_UNIT, VEC_UNIT, ANY_UNIT };
 
-ExecUnit getExecUnit(Opcode op) {
-    switch(op) {
-        case ADD: case SUB: case MUL: case DIV: return ALU_UNIT;
-        case FADD: case FMUL: case FDIV: return FPU_UNIT;
-        case LOAD: case STORE: return MEM_UNIT;
-        case BEQ: case BNE: case JMP: return BRANCH_UNIT;
-        default: return ANY_UNIT;
-    }
-}
-int getLatency(Opcode op) {
-    switch(op) {
-        case ADD: case SUB: return 1;
-        case MUL: return 3;
-        case DIV: return 8;
-        case FADD: return 4;
-        case FMUL: return 5;
-        case FDIV: return 12;
-        case LOAD: return 3;
-        case STORE: return 2;
-        case BEQ: case BNE: case JMP: return 1;
-        default: return 1;
-    }
-}
+// How a trace line's operands are decoded (see isa.def).
+enum OperandFormat { FMT_RRR, FMT_FMA, FMT_MEM, FMT_MEM_SOURCE, FMT_COND_BRANCH, FMT_JUMP, FMT_RETURN };
+enum OpcodeFlag {
+    OP_FP = 1 << 0,
+    OP_VECTOR = 1 << 1,
+    OP_MEMORY = 1 << 2,
+    OP_STORE = 1 << 3,
+    OP_BRANCH = 1 << 4,
+    OP_UNCONDITIONAL = 1 << 5, // Always taken; only RET's target is predicted
+    OP_ITERATIVE = 1 << 6      // Never pipelined: holds its resource until writeback
+};
+struct OpcodeInfo {
+    const char* mnemonic;
+    OperandFormat format;
+    ExecUnit unit;
+    int latency;
+    double energy;  // Default picojoules per op (per element for vector ops)
+    unsigned flags;
+};
+
+// The opcode enum and its property table are both generated from isa.def.
+enum Opcode {
+#define ISA(name, format, unit, latency, energy, flags) name,
+#include "isa.def"
+#undef ISA
+};
+constexpr OpcodeInfo OPCODE_TABLE[] = {
+#define ISA(name, format, unit, latency, energy, flags) {#name, format, unit, latency, energy, flags},
+#include "isa.def"
+#undef ISA
+};
+constexpr int NUM_OPCODES = sizeof(OPCODE_TABLE) / sizeof(OPCODE_TABLE[0]);
+static_assert(NUM_OPCODES == NOP + 1, "NOP must be the last opcode in isa.def");
+
+constexpr bool hasFlag(Opcode op, unsigned flag) { return (OPCODE_TABLE[op].flags & flag) != 0; }
+constexpr ExecUnit getExecUnit(Opcode op) { return OPCODE_TABLE[op].unit; }
+// Latency of a scalar op, or of the first element group of a vector op.
+constexpr int getLatency(Opcode op) { return OPCODE_TABLE[op].latency; }
+constexpr bool isFpOp(Opcode op) { return hasFlag(op, OP_FP); }
+// Control transfers that are always taken; only RET's target is predicted.
+constexpr bool isUnconditionalBranch(Opcode op) { return hasFlag(op, OP_UNCONDITIONAL); }
+constexpr bool isVectorOp(Opcode op) { return hasFlag(op, OP_VECTOR); }
+constexpr bool isMemoryOp(Opcode op) { return hasFlag(op, OP_MEMORY); }
+constexpr bool isStoreOp(Opcode op) { return hasFlag(op, OP_STORE); }
+constexpr bool isIterativeOp(Opcode op) { return hasFlag(op, OP_ITERATIVE); }
 string opcodeToString(Opcode op) {
-    const char* names[] = {"ADD", "SUB", "MUL", "DIV", "FADD", "FMUL",
-                           "FDIV", "LOAD", "STORE", "BEQ", "BNE", "JMP", "NOP"};
-    return (op <= NOP) ? names[op] : "UNKNOWN";
+    return (op >= 0 && op < NUM_OPCODES) ? OPCODE_TABLE[op].mnemonic : "UNKNOWN";
 }
+// Unknown mnemonics decode as NOP.
 Opcode stringToOpcode(const string& str) {
-    if (str == "ADD") return ADD;
-    if (str == "SUB") return SUB;
-    if (str == "MUL") return MUL;
-    if (str == "DIV") return DIV;
-    if (str == "FADD") return FADD;
-    if (str == "FMUL") return FMUL;
-    if (str == "FDIV") return FDIV;
-    if (str == "LOAD") return LOAD;
-    if (str == "STORE") return STORE;
-    if (str == "BEQ") return BEQ;
-    if (str == "BNE") return BNE;
-    if (str == "JMP") return JMP;
+    for (int op = 0; op < NUM_OPCODES; op++) {
+        if (str == OPCODE_TABLE[op].mnemonic) return (Opcode)op;
+    }
     return NOP;
 }
 string unitToString(ExecUnit u) {
-    const char* names[] = {"ALU", "FPU", "MEM", "BRANCH", "ANY"};
+    const char* names[] = {"ALU", "FPU", "MEM", "BRANCH", "VEC", "ANY"};
     return (u <= ANY_UNIT) ? names[u] : "UNKNOWN";
 }
+ExecUnit stringToUnit(const string& str) {
+    if (str == "ALU") return ALU_UNIT;
+    if (str == "FPU") return FPU_UNIT;
+    if (str == "MEM") return MEM_UNIT;
+    if (str == "BRANCH") return BRANCH_UNIT;
+    if (str == "VEC") return VEC_UNIT;
+    return ANY_UNIT;
+}
+
+// Scalar registers R0-R31 occupy scoreboard slots 0-31,
+// vector registers V0-V31 occupy slots 32-63.
+const int NUM_SCALAR_REGS = 32;
+const int NUM_VECTOR_REGS = 32;
+const int VREG_BASE = NUM_SCALAR_REGS;
+
 int parseRegister(const string& reg_str) {
-    if (reg_str.empty() || reg_str[0] != 'R') return -1;
+    if (reg_str.empty() || (reg_str[0] != 'R' && reg_str[0] != 'V')) return -1;
     try {
-        return stoi(reg_str.substr(1));
+        int n = stoi(reg_str.substr(1));
+        if (reg_str[0] == 'V') return (n >= 0 && n < NUM_VECTOR_REGS) ? VREG_BASE + n : -1;
+        return n;
     } catch (...) {
         return -1;
     }
 }
+// Parses an optional memory address operand (decimal or 0x-prefixed hex).
+bool parseAddress(const string& addr_str, uint64_t& addr) {
+    if (addr_str.empty()) return false;
+    try {
+        addr = stoull(addr_str, nullptr, 0);
+        return true;
+    } catch (...) {
+        return false;
+    }
+}
+string registerToString(int reg) {
+    if (reg >= VREG_BASE) return "V" + to_string(reg - VREG_BASE);
+    return "R" + to_string(reg);
+}
+
+// REGREAD (between ISSUE and EXECUTE) and COMMIT (in-order retirement
+// after WRITEBACK) only exist when the machine config gives them a depth.
+enum Stage { IDLE, FETCH, DECODE, ISSUE, REGREAD, EXECUTE, WRITEBACK, COMMIT, COMPLETE };
+constexpr int NUM_STAGES = COMPLETE + 1;
+string stageToString(Stage s) {
+    const char* names[] = {"IDLE", "FETCH", "DECODE", "ISSUE", "REGREAD",
+                           "EXECUTE", "WRITEBACK", "COMMIT", "COMPLETE"};
+    return (s <= COMPLETE) ? names[s] : "UNKNOWN";
+}
+Stage stringToStage(const string& str) {
+    for (int s = FETCH; s < COMPLETE; s++) {
+        if (stageToString((Stage)s) == str) return (Stage)s;
+    }
+    return IDLE;
+}
+
+// All opcodes executed by one unit class, in enum order.
+vector<Opcode> opsForUnit(ExecUnit unit) {
+    vector<Opcode> ops;
+    for (int op = ADD; op <= NOP; op++) {
+        if (getExecUnit((Opcode)op) == unit) ops.push_back((Opcode)op);
+    }
+    return ops;
+}
+
+// One schedulable execution resource: a unit instance (ALU0, FPU1, ...),
+// an FP pipe, or an issue port. Pipelined resources accept one new op
+// per cycle; dividers (DIV, FDIV) are never pipelined and block their
+// resource until writeback.
+struct PortConfig {
+    string name;
+    vector<Opcode> ops;
+    bool pipelined;
+
+    PortConfig(const string& _name = "", const vector<Opcode>& _ops = {}, bool _pipelined = false)
+        : name(_name), ops(_ops), pipelined(_pipelined) {}
+    bool supports(Opcode op) const { return find(ops.begin(), ops.end(), op) != ops.end(); }
+};
+
+enum PortPolicy { PORT_FIRST_FREE, PORT_ROUND_ROBIN, PORT_LEAST_LOADED };
+PortPolicy stringToPortPolicy(const string& str) {
+    if (str == "roundRobin") return PORT_ROUND_ROBIN;
+    if (str == "leastLoaded") return PORT_LEAST_LOADED;
+    return PORT_FIRST_FREE;
+}
+
+// Parses a list of opcode mnemonics and/or unit class names ("ALU", "FPU", ...).
+vector<Opcode> parseOpList(const json& names) {
+    vector<Opcode> ops;
+    for (const auto& entry : names) {
+        string name = entry.get<string>();
+        ExecUnit unit = stringToUnit(name);
+        vector<Opcode> expanded = (unit != ANY_UNIT) ? opsForUnit(unit)
+                                                     : vector<Opcode>{stringToOpcode(name)};
+        for (Opcode op : expanded) {
+            if (find(ops.begin(), ops.end(), op) == ops.end()) ops.push_back(op);
+        }
+    }
+    return ops;
+}
+
+// Geometry of a set-associative structure (cache or TLB). For TLBs the
+// "line" is a page.
+struct CacheConfig {
+    int size_bytes;
+    int line_bytes;
+    int ways;
+    int miss_latency;
+
+    CacheConfig(int _size = 32768, int _line = 64, int _ways = 8, int _miss = 10)
+        : size_bytes(_size), line_bytes(_line), ways(_ways), miss_latency(_miss) {}
+};
+
+// Reads a count or size field of the machine config. Values below `lo`
+// are raised to it; values above `hi` are rejected, since the tables
+// they size are allocated up front.
+int boundedField(const json& j, const char* key, int fallback, int lo, int hi) {
+    long long value = j.value(key, (long long)fallback);
+    if (value > hi) {
+        throw out_of_range(string(key) + " " + to_string(value) + " is too large (at most " +
+                           to_string(hi) + ").");
+    }
+    return (int)max((long long)lo, value);
+}
+
+CacheConfig parseCacheConfig(const json& j, CacheConfig config) {
+    config.line_bytes = boundedField(j, "lineBytes", config.line_bytes, 1, 4096);
+    config.ways = boundedField(j, "ways", config.ways, 1, 64);
+    long long size = j.value("sizeBytes", (long long)config.size_bytes);
+    if (size > INT_MAX || size / config.line_bytes > (1 << 20)) {
+        throw out_of_range("sizeBytes " + to_string(size) + " is too large (at most 2^20 lines).");
+    }
+    config.size_bytes = max(1, (int)size);
+    config.miss_latency = max(0, j.value("missLatency", config.miss_latency));
+    return config;
+}
+
+// Data TLB hierarchy for LOAD/STORE ops that carry an address operand.
+// An L1 miss that hits the L2 TLB costs l2_latency extra cycles; an L2
+// miss costs l2_latency plus page_walk_latency.
+// Geometry is given in entries, so huge pages never go through a byte size.
+struct TlbConfig {
+    long long page_bytes;  // 4096, or 2 MiB / 1 GiB huge pages
+    int l1_entries, l1_ways;
+    int l2_entries, l2_ways;
+    int l2_latency;
+    int page_walk_latency;
+
+    TlbConfig() : page_bytes(4096), l1_entries(64), l1_ways(4),
+                  l2_entries(1536), l2_ways(12), l2_latency(7), page_walk_latency(30) {}
+};
+
+// Accepts a byte count or a "4K"/"2M"/"1G" style size. Throws
+// invalid_argument on a malformed size and out_of_range on overflow.
+long long parseSizeBytes(const json& j) {
+    if (j.is_number()) return j.get<long long>();
+    string str = j.get<string>();
+    long long multiplier = 1;
+    if (!str.empty()) {
+        char unit = toupper(str.back());
+        if (unit == 'K') multiplier = 1LL << 10;
+        else if (unit == 'M') multiplier = 1LL << 20;
+        else if (unit == 'G') multiplier = 1LL << 30;
+        if (multiplier > 1) str.pop_back();
+    }
+    long long count = stoll(str);
+    if (count > LLONG_MAX / multiplier) throw out_of_range("Size " + j.get<string>() + " is too large.");
+    return count * multiplier;
+}
+
+// L1 data cache with an optional hardware prefetcher, for memory ops
+// that carry an address. A miss costs miss_latency extra cycles; a
+// prefetch issued at cycle c fills its line at c + miss_latency.
+enum PrefetcherType { PREFETCH_NONE, PREFETCH_NEXT_LINE, PREFETCH_STRIDE, PREFETCH_STREAM };
+PrefetcherType stringToPrefetcher(const string& str) {
+    if (str == "nextLine") return PREFETCH_NEXT_LINE;
+    if (str == "stride") return PREFETCH_STRIDE;
+    if (str == "stream") return PREFETCH_STREAM;
+    return PREFETCH_NONE;
+}
+string prefetcherToString(PrefetcherType t) {
+    const char* names[] = {"none", "nextLine", "stride", "stream"};
+    return (t <= PREFETCH_STREAM) ? names[t] : "UNKNOWN";
+}
+
+struct DataCacheConfig {
+    CacheConfig geometry;
+    PrefetcherType prefetcher;
+    int degree;          // Lines prefetched per trigger
+    int distance;        // How many lines (or strides) ahead the first prefetch goes
+    int stream_buffers;  // Concurrent streams tracked by the stream prefetcher
+    int stride_table;    // PCs tracked by the stride prefetcher
+
+    DataCacheConfig() : geometry(32768, 64, 8, 20), prefetcher(PREFETCH_NONE),
+                        degree(1), distance(1), stream_buffers(4), stride_table(64) {}
+};
+
+// Main memory behind MEM_UNIT (and behind the L1 data cache when that
+// is modelled). Lines are interleaved across channels, then rows are
+// split across banks, so sequential lines share an open row.
+struct DramConfig {
+    int channels;
+    int banks;            // Per channel
+    int row_bytes;
+    int line_bytes;
+    int t_rcd, t_cas, t_rp;
+    int t_burst;          // Data-bus cycles per line transfer
+    bool open_page;       // false: close (precharge) the row after every access
+    int queue_size;       // Per-channel request queue entries
+    bool fr_fcfs;         // false: strict FCFS
+    int histogram_bucket; // Latency histogram resolution in cycles
+
+    DramConfig() : channels(1), banks(8), row_bytes(8192), line_bytes(64),
+                   t_rcd(14), t_cas(14), t_rp(14), t_burst(4), open_page(true),
+                   queue_size(32), fr_fcfs(true), histogram_bucket(10) {}
+};
+
+// Data-dependent latency of one opcode ("variableLatency"), driven by
+// operand values annotated on the trace line as "@value" tokens, in
+// source-operand order (e.g. "DIV R3 R1 R2 @1000 @7").
+enum LatencyModel { LATENCY_FIXED, LATENCY_EARLY_OUT, LATENCY_DENORMAL, LATENCY_REGION };
+LatencyModel stringToLatencyModel(const string& str) {
+    if (str == "earlyOut") return LATENCY_EARLY_OUT;
+    if (str == "denormal") return LATENCY_DENORMAL;
+    if (str == "region") return LATENCY_REGION;
+    return LATENCY_FIXED;
+}
+
+struct AddressRegion {
+    uint64_t start, end; // [start, end)
+    int latency;
+};
+
+struct VariableLatencyConfig {
+    LatencyModel model;
+    int min_latency;       // earlyOut: latency for the narrowest operands
+    int max_latency;       // earlyOut: worst case, 0 for the opcode's normal latency
+    int bits_per_step;     // earlyOut: significant bits retired per extra cycle
+    int denormal_penalty;  // denormal: extra cycles for a subnormal operand or result
+    bool single_precision; // denormal: classify values as float rather than double
+    vector<AddressRegion> regions; // region: first match replaces the normal latency
+
+    VariableLatencyConfig() : model(LATENCY_FIXED), min_latency(1), max_latency(0), bits_per_step(4),
+                              denormal_penalty(50), single_precision(false) {}
+};
+
+// Per-event energy costs in picojoules ("energy"). Vector opcodes cost
+// their op energy once per element.
+struct EnergyConfig {
+    array<double, NUM_OPCODES> op_energy;
+    double register_read;
+    double register_write;
+    double memory_access;   // Every memory op (L1 data access)
+    double cache_fill;      // Each L1 data-cache fill (miss or prefetch) from the next level
+    double dram_access;     // Each line transferred by the DRAM model
+    array<double, NUM_STAGES> stage_energy; // Per instruction per cycle spent in the stage
+    double leakage_per_cycle;
+    double frequency_ghz;   // Converts cycles to time for power and energy-delay
+
+    EnergyConfig() : register_read(0.5), register_write(0.8), memory_access(10.0), cache_fill(50.0),
+                     dram_access(500.0), leakage_per_cycle(20.0), frequency_ghz(2.0) {
+        for (int op = 0; op < NUM_OPCODES; op++) op_energy[op] = OPCODE_TABLE[op].energy;
+        stage_energy.fill(0.0);
+        for (int s = FETCH; s < COMPLETE; s++) stage_energy[s] = 0.3;
+    }
+};
+
+// Branch direction prediction for speculative fetch. When configured,
+// fetch follows the predicted direction of each conditional branch; a
+// misprediction sends fetch down the wrong path until the branch resolves.
+enum PredictorType { PREDICT_NOT_TAKEN, PREDICT_TAKEN, PREDICT_BTFN, PREDICT_BIMODAL, PREDICT_GSHARE };
+PredictorType stringToPredictor(const string& str) {
+    if (str == "notTaken") return PREDICT_NOT_TAKEN;
+    if (str == "taken") return PREDICT_TAKEN;
+    if (str == "bimodal") return PREDICT_BIMODAL;
+    if (str == "gshare") return PREDICT_GSHARE;
+    return PREDICT_BTFN;
+}
+string predictorToString(PredictorType t) {
+    const char* names[] = {"notTaken", "taken", "btfn", "bimodal", "gshare"};
+    return (t <= PREDICT_GSHARE) ? names[t] : "UNKNOWN";
+}
+
+struct BranchPredictorConfig {
+    PredictorType type;
+    int table_entries;     // 2-bit counters (bimodal, gshare)
+    int history_bits;      // Global history length (gshare)
+    int wrong_path_limit;  // Wrong-path instructions in flight per misprediction
+
+    BranchPredictorConfig() : type(PREDICT_BTFN), table_entries(1024), history_bits(8),
+                              wrong_path_limit(32) {}
+};
+
+// Instruction fetch: fetches up to `width` instructions per cycle from
+// one aligned block of `block_bytes`, through an I-cache and optionally
+// a decoded-op cache holding `uop_cache_entries` fetch blocks.
+struct FrontEndConfig {
+    int width;
+    int block_bytes;
+    int instruction_bytes;
+    int taken_branch_bubble;   // Fetch cycles lost after a taken branch
+    int ras_entries;           // Return-address stack depth
+    CacheConfig icache;
+    bool uop_cache;
+    int uop_cache_entries;
+    int uop_cache_ways;
+
+    FrontEndConfig() : width(4), block_bytes(16), instruction_bytes(4), taken_branch_bubble(1),
+                       ras_entries(16), icache(32768, 64, 8, 10), uop_cache(false),
+                       uop_cache_entries(64), uop_cache_ways(8) {}
+};
+
+// --- Machine configuration (optional "config" object in the input JSON) ---
+// Every field defaults to the original fixed machine, so omitting
+// "config" reproduces the previous results exactly.
+struct MachineConfig {
+    map<ExecUnit, int> unit_counts;
+    int vector_length_bits;  // Width of one vector register
+    int element_width_bits;  // Width of one lane element
+    int vector_lanes;        // Elements processed per cycle by a VEC unit
+    bool vector_chaining;    // Dependent vector ops may start on the first element group
+    array<int, NUM_OPCODES> op_latency; // isa.def latencies with "latencies" applied
+    map<Opcode, VariableLatencyConfig> variable_latency;
+    vector<PortConfig> fp_pipes;    // Empty: unit_counts[FPU_UNIT] generic non-pipelined pipes
+    int fp_bypass_latency;          // Extra cycles before an FP result reaches an FP consumer
+    int fp_cross_bypass_latency;    // Extra cycles before an FP result reaches a non-FP consumer
+    vector<PortConfig> ports;       // Non-empty: dispatch to ports instead of unit classes
+    PortPolicy port_policy;
+    int utilization_bucket_cycles;  // Resolution of the utilization timeline
+    array<int, NUM_STAGES> stage_depth; // Cycles per stage; EXECUTE is latency-driven
+    int rf_read_ports;              // Register-file reads per cycle (0 = unlimited)
+    int rf_write_ports;             // Register-file writes per cycle (0 = unlimited)
+    int result_buses;               // Results leaving EXECUTE per cycle (0 = unlimited)
+    bool model_front_end;           // false: every instruction is fetched at once
+    FrontEndConfig front_end;
+    bool model_tlb;                 // false: memory ops use their flat latency
+    TlbConfig tlb;
+    bool model_dcache;
+    DataCacheConfig dcache;
+    bool model_dram;
+    DramConfig dram;
+    bool model_speculation;         // Fetch and execute down predicted paths
+    BranchPredictorConfig predictor;
+    bool model_energy;
+    EnergyConfig energy;
+    int max_cycles;                 // Simulation cut-off
+    bool memoize_blocks;            // Replay repeated basic-block intervals (front-end mode)
+    int threads;                    // OpenMP team size (0 = $PIPELINE_THREADS, else 4)
+    bool profile_threads;           // Report time in parallel regions and critical sections
+    bool timeline_pyramid;          // Add the level-of-detail timeline summary
+
+    MachineConfig() : vector_length_bits(256), element_width_bits(32),
+                      vector_lanes(4), vector_chaining(true),
+                      fp_bypass_latency(0), fp_cross_bypass_latency(0),
+                      port_policy(PORT_FIRST_FREE), utilization_bucket_cycles(10),
+                      rf_read_ports(0), rf_write_ports(0), result_buses(0),
+                      model_front_end(false), model_tlb(false), model_dcache(false),
+                      model_dram(false), model_speculation(false),
+                      model_energy(false), max_cycles(500), memoize_blocks(false),
+                      threads(0), profile_threads(false), timeline_pyramid(false) {
+        for (int op = 0; op < NUM_OPCODES; op++) op_latency[op] = OPCODE_TABLE[op].latency;
+        unit_counts[ALU_UNIT] = 2;
+        unit_counts[FPU_UNIT] = 1;
+        unit_counts[MEM_UNIT] = 1;
+        unit_counts[BRANCH_UNIT] = 1;
+        unit_counts[VEC_UNIT] = 1;
+        stage_depth.fill(1);
+        stage_depth[REGREAD] = 0;
+        stage_depth[COMMIT] = 0;
+    }
+
+    int stageDepth(Stage s) const { return stage_depth[s]; }
+    // Stages present in this machine, in pipeline order.
+    vector<Stage> activeStages() const {
+        vector<Stage> stages;
+        for (int s = FETCH; s < COMPLETE; s++) {
+            if (s == EXECUTE || stageDepth((Stage)s) > 0) stages.push_back((Stage)s);
+        }
+        return stages;
+    }
+    // Cycles from fetch to the start of EXECUTE: what a redirect costs
+    // to refill the front end after a mispredicted branch resolves.
+    int frontEndDepth() const {
+        return stageDepth(FETCH) + stageDepth(DECODE) + stageDepth(ISSUE) + stageDepth(REGREAD);
+    }
+
+    int vectorElements() const {
+        return max(1, vector_length_bits / max(1, element_width_bits));
+    }
+    // Number of cycles a VEC unit needs to stream all elements through its lanes.
+    int vectorElementGroups() const {
+        int lanes = max(1, vector_lanes);
+        return (vectorElements() + lanes - 1) / lanes;
+    }
+    // Cycles before its full result at which a producer's first element
+    // group reaches a chained consumer (0 for scalar ops).
+    int chainLead(Opcode op) const {
+        return isVectorOp(op) ? vectorElementGroups() - 1 : 0;
+    }
+};
+
+// Throws json::exception on malformed fields and invalid_argument or
+// out_of_range on unusable values; main() reports either.
+MachineConfig parseMachineConfig(const json& j) {
+    MachineConfig config;
+    if (j.contains("units")) {
+        for (auto& [name, count] : j["units"].items()) {
+            ExecUnit unit = stringToUnit(name);
+            if (unit == ANY_UNIT) continue;
+            if (count.get<long long>() > 64) throw out_of_range("units." + name + " is too large (at most 64).");
+            config.unit_counts[unit] = max(0, count.get<int>());
+        }
+    }
+    if (j.contains("vector")) {
+        const json& v = j["vector"];
+        config.vector_length_bits = boundedField(v, "lengthBits", config.vector_length_bits, INT_MIN, 65536);
+        config.element_width_bits = boundedField(v, "elementWidthBits", config.element_width_bits, INT_MIN, 65536);
+        if (config.vector_length_bits <= 0 || config.element_width_bits <= 0) {
+            throw invalid_argument("vector.lengthBits and vector.elementWidthBits must be positive.");
+        }
+        config.vector_lanes = boundedField(v, "lanes", config.vector_lanes, 1, 1024);
+        config.vector_chaining = v.value("chaining", config.vector_chaining);
+    }
+    if (j.contains("latencies")) {
+        for (auto& [name, latency] : j["latencies"].items()) {
+            Opcode op = stringToOpcode(name);
+            if (op != NOP || name == "NOP") config.op_latency[op] = max(1, latency.get<int>());
+        }
+    }
+    if (j.contains("variableLatency")) {
+        for (auto& [name, vl] : j["variableLatency"].items()) {
+            Opcode op = stringToOpcode(name);
+            if (op == NOP && name != "NOP") continue;
+            VariableLatencyConfig v;
+            v.model = stringToLatencyModel(vl.value("model", string("fixed")));
+            v.min_latency = max(1, vl.value("minLatency", v.min_latency));
+            v.max_latency = max(0, vl.value("maxLatency", v.max_latency));
+            v.bits_per_step = max(1, vl.value("bitsPerStep", v.bits_per_step));
+            v.denormal_penalty = max(0, vl.value("penalty", v.denormal_penalty));
+            v.single_precision = vl.value("precision", string("double")) == "single";
+            if (vl.contains("regions")) {
+                for (const auto& r : vl["regions"]) {
+                    AddressRegion region = {0, 0, max(1, r.value("latency", 1))};
+                    // Bounds may be numbers or strings such as "0x8000".
+                    auto bound = [](const json& b, uint64_t& out) {
+                        if (b.is_string()) parseAddress(b.get<string>(), out);
+                        else out = b.get<uint64_t>();
+                    };
+                    if (r.contains("start")) bound(r["start"], region.start);
+                    if (r.contains("end")) bound(r["end"], region.end);
+                    v.regions.push_back(region);
+                }
+            }
+            config.variable_latency[op] = v;
+        }
+    }
+    if (j.contains("fp")) {
+        const json& fp = j["fp"];
+        config.fp_bypass_latency = max(0, fp.value("bypassLatency", config.fp_bypass_latency));
+        config.fp_cross_bypass_latency = max(0, fp.value("crossDomainBypassLatency",
+                                                          config.fp_cross_bypass_latency));
+        if (fp.contains("pipes")) {
+            if (fp["pipes"].size() > 64) throw out_of_range("fp.pipes is too large (at most 64).");
+            for (const auto& p : fp["pipes"]) {
+                PortConfig pipe("FPU" + to_string(config.fp_pipes.size()),
+                                opsForUnit(FPU_UNIT), p.value("pipelined", true));
+                if (p.contains("ops")) {
+                    pipe.ops.clear();
+                    for (Opcode op : parseOpList(p["ops"])) {
+                        if (isFpOp(op)) pipe.ops.push_back(op);
+                    }
+                }
+                config.fp_pipes.push_back(pipe);
+            }
+            config.unit_counts[FPU_UNIT] = config.fp_pipes.size();
+        }
+    }
+    if (j.contains("ports")) {
+        if (j["ports"].size() > 64) throw out_of_range("ports is too large (at most 64).");
+        for (const auto& p : j["ports"]) {
+            string name = p.value("name", "P" + to_string(config.ports.size()));
+            config.ports.push_back(PortConfig(name, parseOpList(p.at("ops")), p.value("pipelined", true)));
+        }
+    }
+    config.port_policy = stringToPortPolicy(j.value("portPolicy", string("first")));
+    if (j.contains("pipeline")) {
+        for (auto& [name, depth] : j["pipeline"].items()) {
+            Stage stage = stringToStage(name);
+            if (stage == IDLE || stage == EXECUTE) continue;
+            // Only REGREAD and COMMIT are optional; every other stage takes at least a cycle.
+            int min_depth = (stage == REGREAD || stage == COMMIT) ? 0 : 1;
+            config.stage_depth[stage] = max(min_depth, depth.get<int>());
+        }
+    }
+    if (j.contains("registerFile")) {
+        const json& rf = j["registerFile"];
+        config.rf_read_ports = boundedField(rf, "readPorts", config.rf_read_ports, 0, 1024);
+        config.rf_write_ports = boundedField(rf, "writePorts", config.rf_write_ports, 0, 1024);
+    }
+    config.result_buses = boundedField(j, "resultBuses", config.result_buses, 0, 1024);
+    if (j.contains("frontEnd")) {
+        const json& fe = j["frontEnd"];
+        FrontEndConfig& f = config.front_end;
+        config.model_front_end = true;
+        f.width = boundedField(fe, "width", f.width, 1, 64);
+        f.instruction_bytes = boundedField(fe, "instructionBytes", f.instruction_bytes, 1, 64);
+        f.block_bytes = boundedField(fe, "blockBytes", f.block_bytes, f.instruction_bytes, 4096);
+        f.taken_branch_bubble = max(0, fe.value("takenBranchBubble", f.taken_branch_bubble));
+        f.ras_entries = boundedField(fe, "rasEntries", f.ras_entries, 1, 1 << 16);
+        if (fe.contains("icache")) f.icache = parseCacheConfig(fe["icache"], f.icache);
+        if (fe.contains("uopCache")) {
+            const json& uc = fe["uopCache"];
+            f.uop_cache = uc.value("enabled", true);
+            f.uop_cache_entries = boundedField(uc, "entries", f.uop_cache_entries, 1, 1 << 16);
+            f.uop_cache_ways = boundedField(uc, "ways", f.uop_cache_ways, 1, 64);
+        }
+    }
+    if (j.contains("tlb")) {
+        const json& t = j["tlb"];
+        TlbConfig& tlb = config.tlb;
+        config.model_tlb = true;
+        if (t.contains("pageSize")) tlb.page_bytes = max(1LL, parseSizeBytes(t["pageSize"]));
+        if (t.contains("l1")) {
+            tlb.l1_entries = boundedField(t["l1"], "entries", tlb.l1_entries, 1, 1 << 16);
+            tlb.l1_ways = boundedField(t["l1"], "ways", tlb.l1_ways, 1, 64);
+        }
+        if (t.contains("l2")) {
+            tlb.l2_entries = boundedField(t["l2"], "entries", tlb.l2_entries, 1, 1 << 16);
+            tlb.l2_ways = boundedField(t["l2"], "ways", tlb.l2_ways, 1, 64);
+            tlb.l2_latency = max(0, t["l2"].value("latency", tlb.l2_latency));
+        }
+        tlb.page_walk_latency = max(0, t.value("pageWalkLatency", tlb.page_walk_latency));
+    }
+    if (j.contains("dcache")) {
+        const json& dc = j["dcache"];
+        DataCacheConfig& d = config.dcache;
+        config.model_dcache = true;
+        d.geometry = parseCacheConfig(dc, d.geometry);
+        if (dc.contains("prefetcher")) {
+            const json& pf = dc["prefetcher"];
+            d.prefetcher = stringToPrefetcher(pf.value("type", string("none")));
+            d.degree = boundedField(pf, "degree", d.degree, 1, 64);
+            d.distance = boundedField(pf, "distance", d.distance, 1, 1024);
+            d.stream_buffers = boundedField(pf, "streams", d.stream_buffers, 1, 256);
+            d.stride_table = boundedField(pf, "tableEntries", d.stride_table, 1, 1 << 16);
+        }
+    }
+    if (j.contains("dram")) {
+        const json& dr = j["dram"];
+        DramConfig& d = config.dram;
+        config.model_dram = true;
+        d.channels = boundedField(dr, "channels", d.channels, 1, 64);
+        d.banks = boundedField(dr, "banks", d.banks, 1, 1024);
+        d.line_bytes = boundedField(dr, "lineBytes", d.line_bytes, 1, 4096);
+        d.row_bytes = boundedField(dr, "rowBytes", d.row_bytes, d.line_bytes, 1 << 20);
+        d.t_rcd = max(0, dr.value("tRCD", d.t_rcd));
+        d.t_cas = max(1, dr.value("tCAS", d.t_cas));
+        d.t_rp = max(0, dr.value("tRP", d.t_rp));
+        d.t_burst = max(1, dr.value("tBURST", d.t_burst));
+        d.open_page = dr.value("rowPolicy", string("open")) != "closed";
+        d.queue_size = boundedField(dr, "queueSize", d.queue_size, 1, 4096);
+        d.fr_fcfs = dr.value("scheduler", string("frfcfs")) != "fcfs";
+        d.histogram_bucket = max(1, dr.value("histogramBucketCycles", d.histogram_bucket));
+    }
+    if (j.contains("branchPredictor")) {
+        const json& bp = j["branchPredictor"];
+        BranchPredictorConfig& b = config.predictor;
+        config.model_speculation = true;
+        b.type = stringToPredictor(bp.value("type", string("btfn")));
+        b.table_entries = boundedField(bp, "tableEntries", b.table_entries, 1, 1 << 20);
+        b.history_bits = min(30, max(0, bp.value("historyBits", b.history_bits)));
+        b.wrong_path_limit = boundedField(bp, "wrongPathLimit", b.wrong_path_limit, 0, 4096);
+    }
+    if (j.contains("energy")) {
+        const json& en = j["energy"];
+        EnergyConfig& e = config.energy;
+        config.model_energy = true;
+        if (en.contains("ops")) {
+            for (auto& [name, pj] : en["ops"].items()) {
+                Opcode op = stringToOpcode(name);
+                if (op != NOP || name == "NOP") e.op_energy[op] = max(0.0, pj.get<double>());
+            }
+        }
+        e.register_read = max(0.0, en.value("registerRead", e.register_read));
+        e.register_write = max(0.0, en.value("registerWrite", e.register_write));
+        e.memory_access = max(0.0, en.value("memoryAccess", e.memory_access));
+        e.cache_fill = max(0.0, en.value("cacheFill", e.cache_fill));
+        e.dram_access = max(0.0, en.value("dramAccess", e.dram_access));
+        if (en.contains("stages")) {
+            for (auto& [name, pj] : en["stages"].items()) {
+                Stage stage = stringToStage(name);
+                if (stage != IDLE) e.stage_energy[stage] = max(0.0, pj.get<double>());
+            }
+        }
+        e.leakage_per_cycle = max(0.0, en.value("leakagePerCycle", e.leakage_per_cycle));
+        e.frequency_ghz = en.value("frequencyGHz", e.frequency_ghz);
+        if (e.frequency_ghz <= 0) e.frequency_ghz = EnergyConfig().frequency_ghz;
+    }
+    config.max_cycles = max(1, j.value("maxCycles", config.max_cycles));
+    config.memoize_blocks = j.value("memoizeBlocks", config.memoize_blocks);
+    config.threads = boundedField(j, "threads", config.threads, 0, 1024);
+    config.profile_threads = j.value("profileThreads", config.profile_threads);
+    config.timeline_pyramid = j.value("timelinePyramid", config.timeline_pyramid);
+    config.utilization_bucket_cycles = max(1, j.value("utilizationBucketCycles",
+                                                      config.utilization_bucket_cycles));
+    return config;
+}
+
+// Full execution latency: vector ops stream their element groups
+// through the lanes after the first group's pipeline latency.
+int getInstructionLatency(Opcode op, const MachineConfig& config) {
+    int latency = config.op_latency[op];
+    if (isVectorOp(op)) latency += config.vectorElementGroups() - 1;
+    return latency;
+}
+
+// --- Instructions and their pipeline state ---
+struct Instruction {
+    int id;
+    Opcode opcode;
+    int src1, src2, dest;
+    int src3; // Third source (accumulator of FMA/VFMA), -1 if unused
+    bool has_address;  // Memory ops may carry an explicit data address
+    uint64_t address;
+    bool is_branch;
+    int branch_target;
+    bool taken;             // Actual branch direction on the traced path
+    int pc;                 // Static PC (instruction slot, from 1); loop iterations share it
+    int target_pc;          // Static PC a taken branch continues at
+    vector<string> operand_values; // "@value" annotations, in source-operand order
+    string original_string; // Store the original instruction string
+
+    // Register-file read ports this instruction needs at issue.
+    int registerReads() const {
+        return (src1 >= 0) + (src2 >= 0) + (src3 >= 0);
+    }
+
+    Instruction(int _id, Opcode _op, int _s1, int _s2, int _d,
+                const string& _orig, bool _br = false, int _bt = 0)
+        : id(_id), opcode(_op), src1(_s1), src2(_s2), dest(_d), src3(-1),
+          has_address(false), address(0), is_branch(_br), branch_target(_bt), taken(false),
+          pc(_id), target_pc(_bt), original_string(_orig) {}
+};
+
+// Significant bits of an integer operand value (0 for zero).
+int significantBits(long long value) {
+    unsigned long long magnitude = value < 0 ? -(unsigned long long)value : value;
+    int bits = 0;
+    while (magnitude) { bits++; magnitude >>= 1; }
+    return bits;
+}
+
+bool isSubnormal(double value, bool single_precision) {
+    if (value == 0 || !isfinite(value)) return false;
+    return single_precision ? fabs(value) < FLT_MIN : fpclassify(value) == FP_SUBNORMAL;
+}
+
+// Latency of one dynamic instruction: the opcode's latency, adjusted by
+// the machine's data-dependent model for it when operand values (or, for
+// "region", the data address) are known. Unannotated instructions keep
+// the normal latency.
+int getInstructionLatency(const Instruction& instr, const MachineConfig& config) {
+    Opcode op = instr.opcode;
+    int latency = getInstructionLatency(op, config);
+    auto it = config.variable_latency.find(op);
+    if (it == config.variable_latency.end()) return latency;
+    const VariableLatencyConfig& v = it->second;
+    int groups = isVectorOp(op) ? config.vectorElementGroups() - 1 : 0;
+    int base = latency - groups;
+
+    if (v.model == LATENCY_REGION) {
+        if (!instr.has_address) return latency;
+        for (const auto& region : v.regions) {
+            if (instr.address >= region.start && instr.address < region.end) return region.latency + groups;
+        }
+        return latency;
+    }
+    if (instr.operand_values.empty()) return latency;
+
+    if (v.model == LATENCY_EARLY_OUT) {
+        // Iterative units retire a few bits per cycle and stop early on
+        // narrow operands; a divider only needs the quotient's bits.
+        vector<int> bits;
+        for (const auto& value : instr.operand_values) {
+            try { bits.push_back(significantBits(stoll(value, nullptr, 0))); } catch (...) { return latency; }
+        }
+        int work = *max_element(bits.begin(), bits.end());
+        if (op == DIV && bits.size() >= 2) work = max(0, bits[0] - bits[1]) + 1;
+        int steps = (work + v.bits_per_step - 1) / v.bits_per_step;
+        int worst = v.max_latency > 0 ? v.max_latency : base;
+        return max(v.min_latency, min(worst, v.min_latency + steps - 1)) + groups;
+    }
+    if (v.model == LATENCY_DENORMAL) {
+        // Microcode assist when an input or the rounded result is subnormal.
+        vector<double> values;
+        for (const auto& value : instr.operand_values) {
+            try { values.push_back(stod(value)); } catch (...) { return latency; }
+        }
+        bool slow = false;
+        for (double value : values) slow = slow || isSubnormal(value, v.single_precision);
+        if (values.size() >= 2) {
+            double result = 0;
+            switch (op) {
+                case FADD: case VADD: result = values[0] + values[1]; break;
+                case FMUL: case VMUL: result = values[0] * values[1]; break;
+                case FDIV: result = values[1] != 0 ? values[0] / values[1] : 0; break;
+                case FMA: case VFMA: result = values[0] * values[1] + (values.size() > 2 ? values[2] : 0); break;
+                default: break;
+            }
+            if (v.single_precision) result = (float)result;
+            slow = slow || isSubnormal(result, v.single_precision);
+        }
+        return slow ? latency + v.denormal_penalty : latency;
+    }
+    return latency;
+}
+
+
+struct PipelineState {
+    Stage current_stage;
+    ExecUnit assigned_unit;
+    int assigned_instance; // Execution resource instance, -1 if none
+    int cycles_in_stage;
+    int total_cycles;
+    bool stalled;
+    string stall_reason;
+    int issue_cycle;
+    int complete_cycle;
+    int exec_latency;      // EXECUTE cycles, fixed at issue (includes memory stalls)
+    int mem_request;       // Outstanding DRAM request, -1 if none
+    bool from_uop_cache;   // Delivered by the decoded-op cache: skips legacy decode
+    bool wrong_path;       // Fetched down a mispredicted path; squashed, never retired
+    int static_index;      // Trace position this instruction was fetched from
+    bool resolved;         // Branch outcome known and the predictor trained
+    int operands_read;     // Source operands already read while waiting for RF read ports
+
+    PipelineState() : current_stage(IDLE), assigned_unit(ANY_UNIT), assigned_instance(-1),
+                     cycles_in_stage(0), total_cycles(0), stalled(false),
+                     issue_cycle(-1), complete_cycle(-1), exec_latency(1), mem_request(-1),
+                     from_uop_cache(false), wrong_path(false), static_index(-1), resolved(false),
+                     operands_read(0) {}
+};
+
+// --- Machine models: scoreboard, execution units, front end and memory ---
+class RegisterScoreboard {
+public:
+    // chain_ready_cycle: when the first element group of a vector result
+    // can be forwarded to a chained consumer (== ready_cycle for scalars).
+    struct RegInfo { bool busy; int writer_id; int ready_cycle; int chain_ready_cycle; bool fp_result; };
+private:
+    vector<RegInfo> regs;
+    const int num_registers;
+public:
+    RegisterScoreboard(int num_regs = 32) : num_registers(num_regs), regs(num_regs, {false, -1, -1, -1, false}) {}
+    // bypass_delay: extra cycles before the result reaches this consumer.
+    // It can outlast the writer's WRITEBACK, so it is checked even once
+    // the register is no longer marked busy.
+    bool isBusy(int reg, int current_cycle, bool chained = false, int bypass_delay = 0) {
+        if (reg < 0 || reg >= num_registers) return false;
+        if (!regs[reg].busy && bypass_delay == 0) return false;
+        int ready = chained ? regs[reg].chain_ready_cycle : regs[reg].ready_cycle;
+        return ready + bypass_delay > current_cycle;
+    }
+    void markBusy(int reg, int instr_id, int ready_cycle, int chain_ready_cycle = -1,
+                  bool fp_result = false) {
+        if (reg >= 0 && reg < num_registers) {
+            if (chain_ready_cycle < 0) chain_ready_cycle = ready_cycle;
+            regs[reg] = {true, instr_id, ready_cycle, chain_ready_cycle, fp_result};
+        }
+    }
+    // Only the latest writer may clear the register; an older writer
+    // finishing late must not hide a newer in-flight write.
+    void clearBusy(int reg, int instr_id = -1) {
+        if (reg >= 0 && reg < num_registers &&
+            (instr_id < 0 || regs[reg].writer_id == instr_id)) {
+            regs[reg].busy = false;
+        }
+    }
+    void setReady(int reg, int instr_id, int ready_cycle, int chain_ready_cycle = -1) {
+        if (reg >= 0 && reg < num_registers && regs[reg].writer_id == instr_id) {
+            regs[reg].ready_cycle = ready_cycle;
+            regs[reg].chain_ready_cycle = chain_ready_cycle < 0 ? ready_cycle : chain_ready_cycle;
+        }
+    }
+    // Pushes back the result of a still-current writer (e.g. it lost
+    // result-bus arbitration and stays in EXECUTE another cycle).
+    void delayReady(int reg, int instr_id, int cycles) {
+        if (reg >= 0 && reg < num_registers && regs[reg].writer_id == instr_id) {
+            regs[reg].ready_cycle += cycles;
+            regs[reg].chain_ready_cycle += cycles;
+        }
+    }
+    bool isFpResult(int reg) {
+        return (reg >= 0 && reg < num_registers) ? regs[reg].fp_result : false;
+    }
+    int getWriter(int reg) {
+        return (reg >= 0 && reg < num_registers) ? regs[reg].writer_id : -1;
+    }
+    // Checkpoint of one register, taken before a speculative write.
+    RegInfo save(int reg) const {
+        return (reg >= 0 && reg < num_registers) ? regs[reg] : RegInfo{false, -1, -1, -1, false};
+    }
+    void set(int reg, const RegInfo& info) {
+        if (reg >= 0 && reg < num_registers) regs[reg] = info;
+    }
+    int size() const { return num_registers; }
+    // Undoes a squashed write if that instruction is still the latest writer.
+    void restore(int reg, int instr_id, const RegInfo& prior) {
+        if (reg >= 0 && reg < num_registers && regs[reg].writer_id == instr_id) {
+            regs[reg] = prior;
+        }
+    }
+};
+
+class ExecutionUnits {
+public:
+    // One schedulable resource instance, built either from the unit
+    // classes (class mode) or from config.ports (port mode).
+    struct Instance {
+        PortConfig config;
+        bool blocked;          // Held by a non-pipelined op until release()
+        int last_issue_cycle;
+        int ops_issued;
+        int busy_cycles;
+    };
+    // Non-pipelined resources, and dividers on any resource, are held
+    // from issue until the op releases them at writeback.
+    static bool blocksInstance(const Instance& inst, Opcode op) {
+        return !inst.config.pipelined || isIterativeOp(op);
+    }
+private:
+    vector<Instance> instances;
+    bool port_mode;
+    PortPolicy policy;
+    int rr_next;
+    int bucket_cycles;
+    vector<vector<int>> bucket_busy; // [bucket][instance] busy cycles
+    bool record_cycles;
+    vector<vector<char>> cycle_busy; // [cycle - 1][instance], when record_cycles
+
+    bool canAccept(const Instance& inst, Opcode op, int cycle) const {
+        return inst.config.supports(op) && !inst.blocked && inst.last_issue_cycle != cycle;
+    }
+    // The policy is fixed for the run, so each one gets its own scan.
+    int findInstance(Opcode op, int cycle) const {
+        int n = instances.size();
+        if (policy == PORT_ROUND_ROBIN) {
+            for (int k = 0, idx = rr_next; k < n; k++, idx = (idx + 1 == n) ? 0 : idx + 1) {
+                if (canAccept(instances[idx], op, cycle)) return idx;
+            }
+            return -1;
+        }
+        if (policy == PORT_LEAST_LOADED) {
+            int best = -1;
+            for (int k = 0; k < n; k++) {
+                if (!canAccept(instances[k], op, cycle)) continue;
+                if (best < 0 || instances[k].ops_issued < instances[best].ops_issued) best = k;
+            }
+            return best;
+        }
+        for (int k = 0; k < n; k++) {
+            if (canAccept(instances[k], op, cycle)) return k;
+        }
+        return -1;
+    }
+public:
+    ExecutionUnits(const MachineConfig& config = MachineConfig())
+        : port_mode(!config.ports.empty()), policy(config.port_policy), rr_next(0),
+          bucket_cycles(config.utilization_bucket_cycles), record_cycles(config.timeline_pyramid) {
+        vector<PortConfig> resources = config.ports;
+        if (!port_mode) {
+            for (const auto& [unit, count] : config.unit_counts) {
+                if (unit == FPU_UNIT && !config.fp_pipes.empty()) {
+                    resources.insert(resources.end(), config.fp_pipes.begin(), config.fp_pipes.end());
+                    continue;
+                }
+                for (int k = 0; k < count; k++) {
+                    resources.push_back(PortConfig(unitToString(unit) + to_string(k), opsForUnit(unit)));
+                }
+            }
+        }
+        for (const auto& r : resources) instances.push_back({r, false, -1, 0, 0});
+    }
+    // Ops of ANY_UNIT (NOP) need no execution resource.
+    bool isAvailable(ExecUnit unit, Opcode op, int cycle) {
+        return unit == ANY_UNIT || findInstance(op, cycle) >= 0;
+    }
+    // Returns the allocated instance index, or -1 if none was needed or free.
+    int allocate(ExecUnit unit, Opcode op, int cycle) {
+        if (unit == ANY_UNIT) return -1;
+        int idx = findInstance(op, cycle);
+        if (idx >= 0) {
+            Instance& inst = instances[idx];
+            inst.last_issue_cycle = cycle;
+            inst.blocked = blocksInstance(inst, op);
+            inst.ops_issued++;
+            rr_next = (idx + 1) % instances.size();
+        }
+        return idx;
+    }
+    // Only the blocking op itself unblocks its instance; pipelined ops
+    // still in flight behind it must not.
+    void release(int instance, Opcode op) {
+        if (instance >= 0 && instance < (int)instances.size() &&
+            blocksInstance(instances[instance], op)) {
+            instances[instance].blocked = false;
+        }
+    }
+    // Accumulates per-instance busy cycles, overall and per timeline
+    // bucket (and per cycle when recording); call once per cycle (cycles
+    // start at 1) after ISSUE.
+    void tick(int cycle) {
+        size_t bucket = (cycle - 1) / bucket_cycles;
+        if (bucket_busy.size() <= bucket) bucket_busy.resize(bucket + 1, vector<int>(instances.size(), 0));
+        if (record_cycles && cycle_busy.size() < (size_t)cycle) cycle_busy.resize(cycle, vector<char>(instances.size(), 0));
+        for (size_t k = 0; k < instances.size(); k++) {
+            Instance& inst = instances[k];
+            if (inst.blocked || inst.last_issue_cycle == cycle) {
+                inst.busy_cycles++;
+                bucket_busy[bucket][k]++;
+                if (record_cycles) cycle_busy[cycle - 1][k] = 1;
+            }
+        }
+    }
+    void reset() {
+        for (auto& inst : instances) {
+            inst.blocked = false;
+            inst.last_issue_cycle = -1;
+            inst.ops_issued = 0;
+            inst.busy_cycles = 0;
+        }
+        rr_next = 0;
+        bucket_busy.clear();
+        cycle_busy.clear();
+    }
+    bool isPortMode() const { return port_mode; }
+    bool hasResourceFor(Opcode op) const {
+        if (getExecUnit(op) == ANY_UNIT) return true;
+        for (const auto& inst : instances) {
+            if (inst.config.supports(op)) return true;
+        }
+        return false;
+    }
+    // Name used in structural stall reasons: the unit class, or the
+    // eligible ports ("P0/P1") in port mode.
+    string resourceName(ExecUnit unit, Opcode op) const {
+        if (!port_mode) return unitToString(unit);
+        string names;
+        for (const auto& inst : instances) {
+            if (!inst.config.supports(op)) continue;
+            if (!names.empty()) names += "/";
+            names += inst.config.name;
+        }
+        return names;
+    }
+    const vector<Instance>& getInstances() const { return instances; }
+
+    // Block-memoization support: the state that decides future issue, the
+    // busy pattern of one cycle, and replaying a recorded interval.
+    string memoKey() const {
+        ostringstream key;
+        int min_ops = INT_MAX;
+        for (const auto& inst : instances) min_ops = min(min_ops, inst.ops_issued);
+        for (const auto& inst : instances) {
+            key << inst.blocked;
+            if (policy == PORT_LEAST_LOADED) key << ':' << inst.ops_issued - min_ops;
+            key << ',';
+        }
+        if (policy == PORT_ROUND_ROBIN) key << rr_next;
+        return key.str();
+    }
+    vector<char> busyAt(int cycle) const {
+        vector<char> busy(instances.size());
+        for (size_t k = 0; k < instances.size(); k++) {
+            busy[k] = instances[k].blocked || instances[k].last_issue_cycle == cycle;
+        }
+        return busy;
+    }
+    int roundRobinNext() const { return rr_next; }
+    // `from`/`to` are the instances at the start and end of the recorded
+    // interval (`to` with cycles relative to its start); `busy` holds its
+    // per-cycle busy pattern from `first_cycle`.
+    void replay(const vector<Instance>& from, const vector<Instance>& to, int to_rr_next,
+                int cycle_offset, const vector<vector<char>>& busy, int first_cycle) {
+        for (size_t k = 0; k < instances.size(); k++) {
+            instances[k].blocked = to[k].blocked;
+            instances[k].last_issue_cycle = to[k].last_issue_cycle + cycle_offset;
+            instances[k].ops_issued += to[k].ops_issued - from[k].ops_issued;
+        }
+        rr_next = to_rr_next;
+        for (size_t c = 0; c < busy.size(); c++) {
+            int cycle = first_cycle + c;
+            size_t bucket = (cycle - 1) / bucket_cycles;
+            if (bucket_busy.size() <= bucket) bucket_busy.resize(bucket + 1, vector<int>(instances.size(), 0));
+            if (record_cycles && cycle_busy.size() < (size_t)cycle) cycle_busy.resize(cycle, vector<char>(instances.size(), 0));
+            for (size_t k = 0; k < instances.size(); k++) {
+                if (!busy[c][k]) continue;
+                instances[k].busy_cycles++;
+                bucket_busy[bucket][k]++;
+                if (record_cycles) cycle_busy[cycle - 1][k] = 1;
+            }
+        }
+    }
+    int getBucketCycles() const { return bucket_cycles; }
+    const vector<vector<int>>& getBucketBusy() const { return bucket_busy; }
+    const vector<vector<char>>& getCycleBusy() const { return cycle_busy; }
+};
+
+// Set-associative LRU tag store shared by the front-end and memory
+// models. Only tags are tracked; addresses are byte addresses.
+class CacheModel {
+private:
+    int num_sets;
+    int ways;
+    uint64_t line_bytes;
+    vector<vector<uint64_t>> sets; // Each set holds line numbers, MRU first
+public:
+    int hits;
+    int misses;
+
+    CacheModel(const CacheConfig& config = CacheConfig())
+        : ways(max(1, config.ways)), line_bytes(max(1, config.line_bytes)), hits(0), misses(0) {
+        num_sets = max(1LL, config.size_bytes / ((long long)line_bytes * ways));
+        sets.resize(num_sets);
+    }
+    // Geometry by entry count, for structures whose byte size can
+    // exceed an int (TLBs with huge pages).
+    CacheModel(int entries, int _ways, uint64_t _line_bytes)
+        : num_sets(max(1, entries / max(1, _ways))), ways(max(1, _ways)),
+          line_bytes(max<uint64_t>(1, _line_bytes)), hits(0), misses(0) {
+        sets.resize(num_sets);
+    }
+    uint64_t lineOf(uint64_t addr) const { return addr / line_bytes; }
+    size_t setIndex(uint64_t addr) const { return lineOf(addr) % num_sets; }
+    const vector<uint64_t>& setLines(size_t set) const { return sets[set]; }
+    bool contains(uint64_t addr) const {
+        uint64_t line = lineOf(addr);
+        const auto& set = sets[line % num_sets];
+        return find(set.begin(), set.end(), line) != set.end();
+    }
+    // Inserts the line as MRU, evicting the LRU line of a full set.
+    // Returns true and sets *evicted if a line was evicted.
+    bool fill(uint64_t addr, uint64_t* evicted = nullptr) {
+        uint64_t line = lineOf(addr);
+        auto& set = sets[line % num_sets];
+        auto it = find(set.begin(), set.end(), line);
+        bool evicts = false;
+        if (it != set.end()) {
+            set.erase(it);
+        } else if ((int)set.size() >= ways) {
+            if (evicted) *evicted = set.back();
+            set.pop_back();
+            evicts = true;
+        }
+        set.insert(set.begin(), line);
+        return evicts;
+    }
+    void invalidate(uint64_t addr) {
+        uint64_t line = lineOf(addr);
+        auto& set = sets[line % num_sets];
+        set.erase(remove(set.begin(), set.end(), line), set.end());
+    }
+    // Looks the address up, counts the hit or miss and fills on a miss.
+    bool access(uint64_t addr) {
+        bool hit = contains(addr);
+        if (hit) hits++; else misses++;
+        fill(addr);
+        return hit;
+    }
+};
+
+// Direction predictor used by speculative fetch, indexed by the branch's
+// static PC; counters train when the branch resolves.
+class BranchPredictor {
+private:
+    BranchPredictorConfig config;
+    vector<uint8_t> counters; // 2-bit saturating, >= 2 predicts taken
+    uint32_t history;         // Global outcome history, newest in bit 0
+
+    size_t index(int pc) const {
+        uint32_t i = pc;
+        if (config.type == PREDICT_GSHARE) i ^= history & ((1u << config.history_bits) - 1);
+        return i % counters.size();
+    }
+public:
+    BranchPredictor(const BranchPredictorConfig& cfg)
+        : config(cfg), counters(cfg.table_entries, 1), history(0) {}
+
+    bool predict(const Instruction& instr) const {
+        if (isUnconditionalBranch(instr.opcode)) return true;
+        switch (config.type) {
+            case PREDICT_NOT_TAKEN: return false;
+            case PREDICT_TAKEN: return true;
+            case PREDICT_BIMODAL:
+            case PREDICT_GSHARE: return counters[index(instr.pc)] >= 2;
+            default: return instr.target_pc <= instr.pc; // Backward taken, forward not taken
+        }
+    }
+    void update(const Instruction& instr, bool taken) {
+        if (isUnconditionalBranch(instr.opcode)) return;
+        uint8_t& c = counters[index(instr.pc)];
+        if (taken && c < 3) c++;
+        if (!taken && c > 0) c--;
+        history = (history << 1) | (taken ? 1 : 0);
+    }
+};
+
+// Return-address stack: a fetched CALL pushes the PC it returns to and a
+// fetched RET pops its predicted target PC. A full stack drops its
+// oldest entry (overflow), so deep call chains mispredict their
+// outermost returns; an empty stack has no prediction (underflow).
+class ReturnAddressStack {
+private:
+    int capacity;
+    deque<int> entries;
+public:
+    int calls, returns, overflows, underflows, mispredictions;
+
+    ReturnAddressStack(int _capacity)
+        : capacity(_capacity), calls(0), returns(0), overflows(0), underflows(0), mispredictions(0) {}
+
+    void push(int return_pc) {
+        calls++;
+        if ((int)entries.size() == capacity) {
+            entries.pop_front();
+            overflows++;
+        }
+        entries.push_back(return_pc);
+    }
+    // Predicted return PC, or -1 when the stack is empty.
+    int pop() {
+        returns++;
+        if (entries.empty()) {
+            underflows++;
+            return -1;
+        }
+        int top = entries.back();
+        entries.pop_back();
+        return top;
+    }
+    int peek() const { return entries.empty() ? -1 : entries.back(); }
+
+    json toJson() const {
+        json j;
+        j["entries"] = capacity;
+        j["calls"] = calls;
+        j["returns"] = returns;
+        j["overflows"] = overflows;
+        j["underflows"] = underflows;
+        j["mispredictions"] = mispredictions;
+        j["accuracy"] = returns > 0 ? (double)(returns - mispredictions) / returns : 0.0;
+        return j;
+    }
+};
+
+// Instruction fetch model, used when the machine config has "frontEnd".
+// An instruction sits at address (pc - 1) * instruction_bytes, so every
+// iteration of a loop fetches the same lines and blocks.
+// Predicted-taken branches end the fetch block and cost
+// taken_branch_bubble cycles. Without a branch predictor, JMP, CALL, RET
+// and backward conditional branches are the ones treated as taken.
+class FetchUnit {
+private:
+    FrontEndConfig config;
+    const vector<Instruction>* trace;
+    const BranchPredictor* predictor;
+    CacheModel icache;
+    CacheModel uop_cache;
+    size_t next;           // Next trace index to fetch
+    int stall_until;       // Fetch resumes at this cycle
+    bool stall_is_miss;    // Current stall is an I-cache miss (else a branch bubble)
+    bool line_ready;       // The missing line has arrived; deliver without another lookup
+    bool logging;
+    vector<pair<bool, uint64_t>> fill_log; // While logging: (uop cache?, address) of each cache update
+
+    bool lookup(uint64_t addr) {
+        if (logging) fill_log.push_back({false, addr});
+        return icache.access(addr);
+    }
+public:
+    using FillLog = vector<pair<bool, uint64_t>>;
+    int fetch_blocks;
+    int icache_miss_stall_cycles;
+    int taken_branch_bubble_cycles;
+
+    FetchUnit(const FrontEndConfig& cfg, const vector<Instruction>& _trace,
+              const BranchPredictor* _predictor = nullptr)
+        : config(cfg), trace(&_trace), predictor(_predictor), icache(cfg.icache),
+          uop_cache(cfg.uop_cache_entries, cfg.uop_cache_ways, cfg.block_bytes),
+          next(0), stall_until(0), stall_is_miss(false), line_ready(false), logging(false),
+          fetch_blocks(0), icache_miss_stall_cycles(0), taken_branch_bubble_cycles(0) {}
+
+    uint64_t addressOf(const Instruction& instr) const {
+        return (uint64_t)(instr.pc - 1) * config.instruction_bytes;
+    }
+    bool predictedTaken(const Instruction& instr) const {
+        if (predictor && instr.is_branch) return predictor->predict(instr);
+        return isUnconditionalBranch(instr.opcode) || (instr.is_branch && instr.target_pc <= instr.pc);
+    }
+
+    // Moves this cycle's fetch group from IDLE to FETCH. Only trace
+    // indices below `limit` may be fetched (speculation holds fetch back
+    // past a mispredicted branch).
+    void fetch(int cycle, vector<PipelineState>& states, size_t limit) {
+        const vector<Instruction>& instrs = *trace;
+        if (next >= limit) return;
+        if (cycle < stall_until) {
+            if (stall_is_miss) icache_miss_stall_cycles++; else taken_branch_bubble_cycles++;
+            return;
+        }
+
+        uint64_t block = addressOf(instrs[next]) / config.block_bytes;
+        bool uop_hit = config.uop_cache && uop_cache.contains(block * config.block_bytes);
+        if (!uop_hit && !line_ready && !lookup(addressOf(instrs[next]))) {
+            // The line arrives after the miss latency; fetch delivers then.
+            stall_until = cycle + max(1, config.icache.miss_latency);
+            stall_is_miss = true;
+            line_ready = true;
+            icache_miss_stall_cycles++;
+            return;
+        }
+        line_ready = false;
+        if (config.uop_cache) {
+            // Blocks decoded by the legacy path are installed for next time.
+            if (uop_hit) uop_cache.hits++; else uop_cache.misses++;
+            uop_cache.fill(block * config.block_bytes);
+            if (logging) fill_log.push_back({true, block * config.block_bytes});
+        }
+
+        fetch_blocks++;
+        for (int n = 0; n < config.width && next < limit; n++) {
+            if (addressOf(instrs[next]) / config.block_bytes != block) break;
+            states[next].current_stage = FETCH;
+            states[next].cycles_in_stage = 0;
+            states[next].from_uop_cache = uop_hit;
+            bool taken = predictedTaken(instrs[next]);
+            next++;
+            if (taken) {
+                stall_until = cycle + 1 + config.taken_branch_bubble;
+                stall_is_miss = false;
+                break;
+            }
+        }
+    }
+
+    // Wrong-path fetch: the line is looked up (and filled) in the I-cache,
+    // but delivery is not delayed by a miss.
+    void touch(const Instruction& instr) { lookup(addressOf(instr)); }
+
+    // Block-memoization support. Loop iterations refetch the same lines,
+    // so an interval's hits and misses depend on the contents of every
+    // I-cache and uop-cache set its fetches map to; the key lists those
+    // sets, and replay reapplies the interval's cache updates in order.
+    struct Snapshot {
+        size_t next;
+        int stall_until;
+        bool stall_is_miss, line_ready;
+        int fetch_blocks, icache_miss_stall_cycles, taken_branch_bubble_cycles;
+        int icache_hits, icache_misses, uop_hits, uop_misses;
+    };
+    size_t nextIndex() const { return next; }
+    Snapshot snapshot() const {
+        return {next, stall_until, stall_is_miss, line_ready,
+                fetch_blocks, icache_miss_stall_cycles, taken_branch_bubble_cycles,
+                icache.hits, icache.misses, uop_cache.hits, uop_cache.misses};
+    }
+    void startLog() {
+        fill_log.clear();
+        logging = true;
+    }
+    FillLog takeLog() {
+        logging = false;
+        return move(fill_log);
+    }
+    // Everything that decides how fetch proceeds from the start of cycle
+    // base + 1 while it fetches trace indices up to `last`.
+    string memoKey(int base, size_t last) const {
+        const vector<Instruction>& instrs = *trace;
+        int stall = max(1, stall_until - base);
+        ostringstream key;
+        key << stall << ',' << (stall > 1 && stall_is_miss) << ',' << line_ready << ';';
+        vector<size_t> icache_sets, uop_sets;
+        for (size_t i = next; i <= last && i < instrs.size(); i++) {
+            uint64_t addr = addressOf(instrs[i]);
+            size_t set = icache.setIndex(addr);
+            if (find(icache_sets.begin(), icache_sets.end(), set) == icache_sets.end()) {
+                icache_sets.push_back(set);
+                key << 'I' << set << ':';
+                for (uint64_t line : icache.setLines(set)) key << line << ',';
+            }
+            if (!config.uop_cache) continue;
+            set = uop_cache.setIndex(addr);
+            if (find(uop_sets.begin(), uop_sets.end(), set) == uop_sets.end()) {
+                uop_sets.push_back(set);
+                key << 'U' << set << ':';
+                for (uint64_t line : uop_cache.setLines(set)) key << line << ',';
+            }
+        }
+        return key.str();
+    }
+    void replay(const Snapshot& from, const Snapshot& to, int cycle_offset, const FillLog& fills) {
+        next += to.next - from.next;
+        stall_until = to.stall_until + cycle_offset;
+        stall_is_miss = to.stall_is_miss;
+        line_ready = to.line_ready;
+        fetch_blocks += to.fetch_blocks - from.fetch_blocks;
+        icache_miss_stall_cycles += to.icache_miss_stall_cycles - from.icache_miss_stall_cycles;
+        taken_branch_bubble_cycles += to.taken_branch_bubble_cycles - from.taken_branch_bubble_cycles;
+        icache.hits += to.icache_hits - from.icache_hits;
+        icache.misses += to.icache_misses - from.icache_misses;
+        uop_cache.hits += to.uop_hits - from.uop_hits;
+        uop_cache.misses += to.uop_misses - from.uop_misses;
+        for (const auto& [uop, addr] : fills) {
+            if (uop) uop_cache.fill(addr); else icache.fill(addr);
+        }
+    }
+
+    json toJson() const {
+        json j;
+        j["fetchBlocks"] = fetch_blocks;
+        j["icacheHits"] = icache.hits;
+        j["icacheMisses"] = icache.misses;
+        j["icacheMissStallCycles"] = icache_miss_stall_cycles;
+        j["takenBranchBubbleCycles"] = taken_branch_bubble_cycles;
+        j["frontEndStallCycles"] = icache_miss_stall_cycles + taken_branch_bubble_cycles;
+        if (config.uop_cache) {
+            j["uopCacheHits"] = uop_cache.hits;
+            j["uopCacheMisses"] = uop_cache.misses;
+        }
+        return j;
+    }
+};
+
+// Two-level data TLB. translate() returns the extra cycles the access
+// spends on translation before the flat memory latency applies.
+class DataTLB {
+private:
+    TlbConfig config;
+    CacheModel l1;
+    CacheModel l2;
+public:
+    int page_walks;
+    long long stall_cycles;
 
-// --- (Instruction, Stage, PipelineState structs are unchanged) ---
-struct Instruction {
-    int id;
-    Opcode opcode;
-    int src1, src2, dest;
-    bool is_branch;
-    int branch_target;
-    string original_string; // Store the original instruction string
+    DataTLB(const TlbConfig& cfg)
+        : config(cfg),
+          l1(cfg.l1_entries, cfg.l1_ways, cfg.page_bytes),
+          l2(cfg.l2_entries, cfg.l2_ways, cfg.page_bytes),
+          page_walks(0), stall_cycles(0) {}
 
-    Instruction(int _id, Opcode _op, int _s1, int _s2, int _d,
-                const string& _orig, bool _br = false, int _bt = 0)
-        : id(_id), opcode(_op), src1(_s1), src2(_s2), dest(_d),
-          original_string(_orig), is_branch(_br), branch_target(_bt) {}
+    int translate(uint64_t addr) {
+        int extra = 0;
+        if (!l1.access(addr)) {
+            extra += config.l2_latency;
+            if (!l2.access(addr)) {
+                extra += config.page_walk_latency;
+                page_walks++;
+            }
+        }
+        stall_cycles += extra;
+        return extra;
+    }
+
+    json toJson() const {
+        json j;
+        j["pageBytes"] = config.page_bytes;
+        j["l1Hits"] = l1.hits;
+        j["l1Misses"] = l1.misses;
+        j["l2Hits"] = l2.hits;
+        j["l2Misses"] = l2.misses;
+        j["pageWalks"] = page_walks;
+        j["stallCycles"] = stall_cycles;
+        return j;
+    }
 };
 
-enum Stage { IDLE, FETCH, DECODE, ISSUE, EXECUTE, WRITEBACK, COMPLETE };
-string stageToString(Stage s) {
-    const char* names[] = {"IDLE", "FETCH", "DECODE", "ISSUE",
-                           "EXECUTE", "WRITEBACK", "COMPLETE"};
-    return (s <= COMPLETE) ? names[s] : "UNKNOWN";
-}
+// Prefetchers observe the demand stream (PC, line, hit) and return the
+// lines they want fetched.
+class Prefetcher {
+public:
+    virtual ~Prefetcher() {}
+    virtual vector<uint64_t> onAccess(uint64_t pc, uint64_t line, bool miss) = 0;
+};
 
-struct PipelineState {
-    Stage current_stage;
-    ExecUnit assigned_unit;
-    int cycles_in_stage;
-    int total_cycles;
-    bool stalled;
-    string stall_reason;
-    int issue_cycle;
-    int complete_cycle;
+// Tagged next-line: on a miss or on the first use of a prefetched line,
+// fetch the `degree` lines starting `distance` lines ahead.
+class NextLinePrefetcher : public Prefetcher {
+private:
+    int degree, distance;
+public:
+    NextLinePrefetcher(const DataCacheConfig& c) : degree(c.degree), distance(c.distance) {}
+    vector<uint64_t> onAccess(uint64_t /*pc*/, uint64_t line, bool miss) override {
+        vector<uint64_t> lines;
+        if (!miss) return lines;
+        for (int k = 0; k < degree; k++) lines.push_back(line + distance + k);
+        return lines;
+    }
+};
 
-    PipelineState() : current_stage(IDLE), assigned_unit(ANY_UNIT),
-                     cycles_in_stage(0), total_cycles(0), stalled(false),
-                     issue_cycle(-1), complete_cycle(-1) {}
+// Per-PC stride table, keyed by the memory op's static PC so every loop
+// iteration trains the same entry: once the same stride is seen twice in
+// a row for a PC, prefetch `degree` strides starting `distance` strides ahead.
+class StridePrefetcher : public Prefetcher {
+private:
+    struct Entry { uint64_t last_line; int64_t stride; int confidence; int last_use; };
+    map<uint64_t, Entry> table;
+    int degree, distance, capacity, uses;
+public:
+    StridePrefetcher(const DataCacheConfig& c)
+        : degree(c.degree), distance(c.distance), capacity(c.stride_table), uses(0) {}
+    vector<uint64_t> onAccess(uint64_t pc, uint64_t line, bool /*miss*/) override {
+        vector<uint64_t> lines;
+        uses++;
+        auto it = table.find(pc);
+        if (it == table.end()) {
+            if ((int)table.size() >= capacity) {
+                auto lru = min_element(table.begin(), table.end(), [](const auto& a, const auto& b) {
+                    return a.second.last_use < b.second.last_use;
+                });
+                table.erase(lru);
+            }
+            table[pc] = {line, 0, 0, uses};
+            return lines;
+        }
+        Entry& e = it->second;
+        int64_t stride = (int64_t)line - (int64_t)e.last_line;
+        if (stride != 0 && stride == e.stride) {
+            e.confidence = min(e.confidence + 1, 3);
+        } else {
+            e.confidence = 0;
+            e.stride = stride;
+        }
+        e.last_line = line;
+        e.last_use = uses;
+        if (e.confidence >= 1) {
+            for (int k = 0; k < degree; k++) lines.push_back(line + e.stride * (distance + k));
+        }
+        return lines;
+    }
 };
 
-// --- (Scoreboard and ExecUnits classes are unchanged) ---
-class RegisterScoreboard {
+// Stream buffers: a miss adjacent to a tracked stream's last line
+// confirms its direction and prefetches `degree` lines starting
+// `distance` lines past it; other misses allocate a new stream (LRU).
+class StreamPrefetcher : public Prefetcher {
 private:
-    struct RegInfo { bool busy; int writer_id; int ready_cycle; };
-    vector<RegInfo> regs;
-    const int num_registers;
+    struct Stream { uint64_t last_line; int direction; int last_use; };
+    vector<Stream> streams;
+    int degree, distance, capacity, uses;
 public:
-    RegisterScoreboard(int num_regs = 32) : num_registers(num_regs), regs(num_regs, {false, -1, -1}) {}
-    bool isBusy(int reg, int current_cycle) {
-        if (reg < 0 || reg >= num_registers) return false;
-        return regs[reg].busy && regs[reg].ready_cycle > current_cycle;
+    StreamPrefetcher(const DataCacheConfig& c)
+        : degree(c.degree), distance(c.distance), capacity(c.stream_buffers), uses(0) {}
+    vector<uint64_t> onAccess(uint64_t /*pc*/, uint64_t line, bool miss) override {
+        vector<uint64_t> lines;
+        if (!miss) return lines;
+        uses++;
+        for (auto& st : streams) {
+            int64_t delta = (int64_t)line - (int64_t)st.last_line;
+            if (delta != 1 && delta != -1) continue;
+            st.direction = (int)delta;
+            st.last_line = line;
+            st.last_use = uses;
+            for (int k = 0; k < degree; k++) lines.push_back(line + st.direction * (distance + k));
+            return lines;
+        }
+        if ((int)streams.size() >= capacity) {
+            auto lru = min_element(streams.begin(), streams.end(), [](const Stream& a, const Stream& b) {
+                return a.last_use < b.last_use;
+            });
+            streams.erase(lru);
+        }
+        streams.push_back({line, 1, uses});
+        return lines;
     }
-    void markBusy(int reg, int instr_id, int ready_cycle) {
-        if (reg >= 0 && reg < num_registers) {
-            regs[reg] = {true, instr_id, ready_cycle};
+};
+
+unique_ptr<Prefetcher> makePrefetcher(const DataCacheConfig& config) {
+    switch (config.prefetcher) {
+        case PREFETCH_NEXT_LINE: return make_unique<NextLinePrefetcher>(config);
+        case PREFETCH_STRIDE: return make_unique<StridePrefetcher>(config);
+        case PREFETCH_STREAM: return make_unique<StreamPrefetcher>(config);
+        default: return nullptr;
+    }
+}
+
+// Cycle-level DRAM controller: per-channel request queues, per-bank row
+// buffers, tRCD/tCAS/tRP timing, a shared data bus per channel, and
+// FR-FCFS (row hits first, then oldest) or FCFS scheduling. Requests are
+// identified by the id enqueue() returns; completionCycle() reports when
+// the data has been transferred (-1 while pending).
+class DramController {
+private:
+    struct Request { int id; int channel; int bank; int64_t row; int arrival; };
+    struct Bank { int64_t open_row; int ready_cycle; };
+    struct Channel { deque<Request> queue; vector<Bank> banks; int bus_free; long long bus_busy_cycles; };
+    DramConfig config;
+    vector<Channel> channels;
+    vector<int> completion;   // Per request id
+    vector<int> latencies;    // Arrival to completion, per serviced request
+
+    void mapAddress(uint64_t addr, int& channel, int& bank, int64_t& row) const {
+        uint64_t line = addr / config.line_bytes;
+        uint64_t lines_per_row = max(1, config.row_bytes / config.line_bytes);
+        channel = line % config.channels;
+        uint64_t rest = line / config.channels;
+        bank = (rest / lines_per_row) % config.banks;
+        row = rest / (lines_per_row * config.banks);
+    }
+public:
+    int reads, writes, prefetch_requests;
+    int row_hits, row_empty, row_conflicts;
+
+    DramController(const DramConfig& cfg)
+        : config(cfg), reads(0), writes(0), prefetch_requests(0),
+          row_hits(0), row_empty(0), row_conflicts(0) {
+        for (int c = 0; c < cfg.channels; c++) {
+            channels.push_back({deque<Request>(), vector<Bank>(cfg.banks, {-1, 0}), 0, 0});
         }
     }
-    void clearBusy(int reg) {
-        if (reg >= 0 && reg < num_registers) {
-            regs[reg].busy = false; 
+
+    bool canAccept(uint64_t addr) const {
+        int channel, bank;
+        int64_t row;
+        mapAddress(addr, channel, bank, row);
+        return (int)channels[channel].queue.size() < config.queue_size;
+    }
+    // Returns the request id, or -1 if the channel queue is full.
+    int enqueue(uint64_t addr, int arrival, bool is_write, bool is_prefetch) {
+        if (!canAccept(addr)) return -1;
+        Request req;
+        req.id = completion.size();
+        req.arrival = arrival;
+        mapAddress(addr, req.channel, req.bank, req.row);
+        channels[req.channel].queue.push_back(req);
+        completion.push_back(-1);
+        if (is_prefetch) prefetch_requests++;
+        if (is_write) writes++; else reads++;
+        return req.id;
+    }
+    int completionCycle(int id) const {
+        return (id >= 0 && id < (int)completion.size()) ? completion[id] : -1;
+    }
+
+    // Issues at most one request per channel per cycle.
+    void tick(int cycle) {
+        for (auto& ch : channels) {
+            int pick = -1;
+            for (int k = 0; k < (int)ch.queue.size(); k++) {
+                const Request& r = ch.queue[k];
+                bool ready = r.arrival <= cycle && ch.banks[r.bank].ready_cycle <= cycle;
+                if (!config.fr_fcfs) {
+                    if (k == 0 && ready) pick = 0;
+                    break;
+                }
+                if (!ready) continue;
+                if (ch.banks[r.bank].open_row == r.row) { pick = k; break; }
+                if (pick < 0) pick = k;
+            }
+            if (pick < 0) continue;
+
+            Request r = ch.queue[pick];
+            ch.queue.erase(ch.queue.begin() + pick);
+            Bank& bank = ch.banks[r.bank];
+            int latency;
+            if (bank.open_row == r.row) {
+                latency = config.t_cas;
+                row_hits++;
+            } else if (bank.open_row < 0) {
+                latency = config.t_rcd + config.t_cas;
+                row_empty++;
+            } else {
+                latency = config.t_rp + config.t_rcd + config.t_cas;
+                row_conflicts++;
+            }
+            int data_start = max(cycle + latency, ch.bus_free);
+            int done = data_start + config.t_burst;
+            ch.bus_free = done;
+            ch.bus_busy_cycles += config.t_burst;
+            if (config.open_page) {
+                bank.open_row = r.row;
+                bank.ready_cycle = data_start - config.t_cas + config.t_burst;
+            } else {
+                bank.open_row = -1;
+                bank.ready_cycle = done + config.t_rp;
+            }
+            completion[r.id] = done;
+            latencies.push_back(done - r.arrival);
         }
     }
-    int getWriter(int reg) {
-        return (reg >= 0 && reg < num_registers) ? regs[reg].writer_id : -1;
+
+    json toJson(int total_cycles) const {
+        json j;
+        long long bytes = (long long)latencies.size() * config.line_bytes;
+        long long bus_busy = 0;
+        for (const auto& ch : channels) bus_busy += ch.bus_busy_cycles;
+        int serviced = latencies.size();
+        j["reads"] = reads;
+        j["writes"] = writes;
+        j["prefetchRequests"] = prefetch_requests;
+        j["rowHits"] = row_hits;
+        j["rowEmpty"] = row_empty;
+        j["rowConflicts"] = row_conflicts;
+        j["rowHitRate"] = serviced > 0 ? (double)row_hits / serviced : 0.0;
+        j["bytesTransferred"] = bytes;
+        j["bytesPerCycle"] = total_cycles > 0 ? (double)bytes / total_cycles : 0.0;
+        j["busUtilization"] = total_cycles > 0 ? (double)bus_busy / ((long long)total_cycles * channels.size()) : 0.0;
+
+        json latency;
+        vector<int> sorted = latencies;
+        sort(sorted.begin(), sorted.end());
+        auto percentile = [&](double p) {
+            return sorted.empty() ? 0 : sorted[min(sorted.size() - 1, (size_t)(p * sorted.size()))];
+        };
+        double sum = 0;
+        for (int l : sorted) sum += l;
+        latency["average"] = sorted.empty() ? 0.0 : sum / sorted.size();
+        latency["min"] = sorted.empty() ? 0 : sorted.front();
+        latency["p50"] = percentile(0.50);
+        latency["p90"] = percentile(0.90);
+        latency["p99"] = percentile(0.99);
+        latency["max"] = sorted.empty() ? 0 : sorted.back();
+        vector<int> histogram;
+        for (int l : sorted) {
+            size_t b = l / config.histogram_bucket;
+            if (histogram.size() <= b) histogram.resize(b + 1, 0);
+            histogram[b]++;
+        }
+        latency["histogramBucketCycles"] = config.histogram_bucket;
+        latency["histogram"] = histogram;
+        j["latency"] = latency;
+        return j;
     }
 };
 
-class ExecutionUnits {
+// Outcome of a data access: `extra` cycles beyond the flat latency are
+// known now; if `request` >= 0 the op also waits for that DRAM request.
+struct MemAccess {
+    int extra;
+    int request;
+};
+
+class DataCache {
 private:
-    map<ExecUnit, int> available;
-    map<ExecUnit, int> capacity;
+    DataCacheConfig config;
+    CacheModel cache;
+    unique_ptr<Prefetcher> prefetcher;
+    DramController* dram;  // Fills come from DRAM when modelled, else after miss_latency
+    // Prefetched, not yet demanded: line -> fill cycle, or the DRAM request still in flight
+    struct PendingFill { int fill_cycle; int request; };
+    map<uint64_t, PendingFill> pending_prefetch;
+
+    void insert(uint64_t line) {
+        uint64_t evicted;
+        if (cache.fill(line * config.geometry.line_bytes, &evicted) && pending_prefetch.erase(evicted)) {
+            useless_prefetches++;
+        }
+    }
 public:
-    ExecutionUnits() {
-        capacity[ALU_UNIT] = 2;
-        capacity[FPU_UNIT] = 1;
-        capacity[MEM_UNIT] = 1;
-        capacity[BRANCH_UNIT] = 1;
-        available = capacity;
-    }
-    bool isAvailable(ExecUnit unit) { return available.count(unit) ? available[unit] > 0 : false; }
-    bool allocate(ExecUnit unit) {
-        if (isAvailable(unit)) {
-            available[unit]--;
-            return true;
+    long long stall_cycles;
+    int prefetches_issued;
+    int useful_prefetches;   // Prefetched lines later demanded
+    int late_prefetches;     // ... but demanded before the fill completed
+    int useless_prefetches;  // Evicted without being demanded
+
+    DataCache(const DataCacheConfig& cfg, DramController* _dram = nullptr)
+        : config(cfg), cache(cfg.geometry), prefetcher(makePrefetcher(cfg)), dram(_dram), stall_cycles(0),
+          prefetches_issued(0), useful_prefetches(0), late_prefetches(0), useless_prefetches(0) {}
+
+    bool contains(uint64_t addr) const { return cache.contains(addr); }
+    int misses() const { return cache.misses; }
+
+    // Demand access at `cycle`. With DRAM modelled, a miss queues a DRAM
+    // request (the caller checks DramController::canAccept first).
+    MemAccess access(uint64_t pc, uint64_t addr, int cycle, bool is_write) {
+        uint64_t line = cache.lineOf(addr);
+        bool hit = cache.contains(addr);
+        MemAccess result = {0, -1};
+        bool trigger = !hit;
+        if (hit) {
+            cache.hits++;
+            auto it = pending_prefetch.find(line);
+            if (it != pending_prefetch.end()) {
+                useful_prefetches++;
+                int fill = it->second.fill_cycle;
+                if (fill < 0) fill = dram->completionCycle(it->second.request);
+                if (fill < 0) {
+                    late_prefetches++;
+                    result.request = it->second.request;
+                } else if (fill > cycle) {
+                    late_prefetches++;
+                    result.extra = fill - cycle;
+                }
+                pending_prefetch.erase(it);
+                trigger = true; // Tagged: the first use of a prefetched line keeps the stream going
+            }
+        } else {
+            cache.misses++;
+            if (dram) result.request = dram->enqueue(addr, cycle, is_write, false);
+            else result.extra = config.geometry.miss_latency;
         }
-        return false;
+        insert(line);
+
+        if (prefetcher) {
+            for (uint64_t pf : prefetcher->onAccess(pc, line, trigger)) {
+                uint64_t pf_addr = pf * config.geometry.line_bytes;
+                if (cache.contains(pf_addr)) continue;
+                PendingFill fill = {cycle + config.geometry.miss_latency, -1};
+                if (dram) {
+                    // Prefetches are dropped when the DRAM queue is full.
+                    fill = {-1, dram->enqueue(pf_addr, cycle, false, true)};
+                    if (fill.request < 0) continue;
+                }
+                prefetches_issued++;
+                pending_prefetch[pf] = fill;
+                insert(pf);
+            }
+        }
+        stall_cycles += result.extra;
+        return result;
     }
-    void release(ExecUnit unit) {
-        if (available.count(unit) && available[unit] < capacity[unit]) {
-            available[unit]++;
+
+    json toJson() const {
+        json j;
+        j["hits"] = cache.hits;
+        j["misses"] = cache.misses;
+        j["missStallCycles"] = stall_cycles;
+        j["prefetcher"] = prefetcherToString(config.prefetcher);
+        if (prefetcher) {
+            int demand_misses = cache.misses;
+            j["prefetchesIssued"] = prefetches_issued;
+            j["usefulPrefetches"] = useful_prefetches;
+            j["latePrefetches"] = late_prefetches;
+            j["uselessPrefetches"] = useless_prefetches;
+            // accuracy: useful / issued; coverage: share of would-be misses
+            // the prefetcher removed; timeliness: useful prefetches that arrived in time
+            j["accuracy"] = prefetches_issued > 0 ? (double)useful_prefetches / prefetches_issued : 0.0;
+            j["coverage"] = (useful_prefetches + demand_misses) > 0
+                ? (double)useful_prefetches / (useful_prefetches + demand_misses) : 0.0;
+            j["timeliness"] = useful_prefetches > 0
+                ? (double)(useful_prefetches - late_prefetches) / useful_prefetches : 0.0;
         }
+        return j;
     }
-    void reset() { available = capacity; }
 };
 
-// --- (Statistics struct is unchanged) ---
+// --- Statistics and energy accounting ---
 struct Statistics {
     int total_cycles;
     int instructions_completed;
@@ -191,38 +1859,139 @@ struct Statistics {
     int war_hazards; // Not implemented
     int waw_hazords; // Not implemented
     int structural_hazards;
-    int branch_mispredictions; // Not implemented
+    int rf_read_port_stalls;   // Structural, counted in structural_hazards too
+    int rf_write_port_stalls;
+    int result_bus_stalls;
+    int branch_mispredictions; // Counted when speculation is modelled
+    int branches_resolved;
+    int wrong_path_fetched;    // Wasted work down mispredicted paths
+    int wrong_path_issued;
+    int wrong_path_squashed;
+    long long wrong_path_unit_cycles; // Cycles wrong-path ops held an execution resource
+    int fast_path_ops;         // Data-dependent latency below the opcode's normal latency
+    int slow_path_ops;         // ... and above it
+    long long data_dependent_cycles; // Net latency change from operand values
+    long long memory_stall_cycles; // Translation and cache-miss cycles on memory ops
+    int vector_instructions;
+    long long vector_elements; // Scalar-equivalent work done by vector ops
     double ipc;
 
     Statistics() : total_cycles(0), instructions_completed(0), total_stalls(0),
                   raw_hazards(0), war_hazards(0), waw_hazords(0),
-                  structural_hazards(0), branch_mispredictions(0), ipc(0.0) {}
+                  structural_hazards(0), rf_read_port_stalls(0), rf_write_port_stalls(0),
+                  result_bus_stalls(0), branch_mispredictions(0), branches_resolved(0),
+                  wrong_path_fetched(0), wrong_path_issued(0), wrong_path_squashed(0),
+                  wrong_path_unit_cycles(0), fast_path_ops(0), slow_path_ops(0),
+                  data_dependent_cycles(0), memory_stall_cycles(0),
+                  vector_instructions(0), vector_elements(0), ipc(0.0) {}
 
     void calculate() {
         ipc = (total_cycles > 0) ? (double)instructions_completed / total_cycles : 0.0;
     }
+    // Adds the counts accumulated between two snapshots (used when a
+    // memoized interval is replayed).
+    void addDelta(const Statistics& from, const Statistics& to) {
+        total_stalls += to.total_stalls - from.total_stalls;
+        raw_hazards += to.raw_hazards - from.raw_hazards;
+        war_hazards += to.war_hazards - from.war_hazards;
+        waw_hazords += to.waw_hazords - from.waw_hazords;
+        structural_hazards += to.structural_hazards - from.structural_hazards;
+        rf_read_port_stalls += to.rf_read_port_stalls - from.rf_read_port_stalls;
+        rf_write_port_stalls += to.rf_write_port_stalls - from.rf_write_port_stalls;
+        result_bus_stalls += to.result_bus_stalls - from.result_bus_stalls;
+        branch_mispredictions += to.branch_mispredictions - from.branch_mispredictions;
+        branches_resolved += to.branches_resolved - from.branches_resolved;
+        wrong_path_fetched += to.wrong_path_fetched - from.wrong_path_fetched;
+        wrong_path_issued += to.wrong_path_issued - from.wrong_path_issued;
+        wrong_path_squashed += to.wrong_path_squashed - from.wrong_path_squashed;
+        wrong_path_unit_cycles += to.wrong_path_unit_cycles - from.wrong_path_unit_cycles;
+        fast_path_ops += to.fast_path_ops - from.fast_path_ops;
+        slow_path_ops += to.slow_path_ops - from.slow_path_ops;
+        data_dependent_cycles += to.data_dependent_cycles - from.data_dependent_cycles;
+        memory_stall_cycles += to.memory_stall_cycles - from.memory_stall_cycles;
+        vector_instructions += to.vector_instructions - from.vector_instructions;
+        vector_elements += to.vector_elements - from.vector_elements;
+    }
+};
+
+// Event counts for the energy model. Dynamic energy follows the work the
+// machine actually did, wrong-path work included; leakage follows cycles.
+class EnergyModel {
+private:
+    EnergyConfig config;
+    array<long long, NUM_OPCODES> ops;
+    long long register_reads, register_writes, memory_accesses;
+    array<long long, NUM_STAGES> stage_cycles;
+public:
+    EnergyModel(const EnergyConfig& cfg)
+        : config(cfg), register_reads(0), register_writes(0), memory_accesses(0) {
+        ops.fill(0);
+        stage_cycles.fill(0);
+    }
+
+    void onIssue(const Instruction& instr, const MachineConfig& machine) {
+        Opcode op = instr.opcode;
+        ops[op] += isVectorOp(op) ? machine.vectorElements() : 1;
+        register_reads += instr.registerReads();
+        if (instr.dest >= 0) register_writes++;
+        if (isMemoryOp(op)) memory_accesses++;
+    }
+    void onStageCycle(Stage stage) { stage_cycles[stage]++; }
+
+    // cache_fills / dram_transfers come from the memory models, if any.
+    json toJson(int total_cycles, int instructions_completed,
+                long long cache_fills, long long dram_transfers) const {
+        double execute = 0, pipeline = 0;
+        for (int op = 0; op < NUM_OPCODES; op++) execute += config.op_energy[op] * ops[op];
+        for (int s = 0; s < NUM_STAGES; s++) pipeline += config.stage_energy[s] * stage_cycles[s];
+        double register_file = register_reads * config.register_read + register_writes * config.register_write;
+        double memory = memory_accesses * config.memory_access + cache_fills * config.cache_fill +
+                        dram_transfers * config.dram_access;
+        double leakage = total_cycles * config.leakage_per_cycle;
+        double total = execute + pipeline + register_file + memory + leakage;
+        double time_ns = total_cycles / config.frequency_ghz;
+
+        json j;
+        json breakdown;
+        breakdown["execute"] = execute;
+        breakdown["registerFile"] = register_file;
+        breakdown["memory"] = memory;
+        breakdown["pipeline"] = pipeline;
+        breakdown["leakage"] = leakage;
+        j["breakdownPj"] = breakdown;
+        j["totalEnergyPj"] = total;
+        j["frequencyGHz"] = config.frequency_ghz;
+        j["averagePowerMw"] = time_ns > 0 ? total / time_ns : 0.0; // pJ/ns == mW
+        j["energyDelayProductPjNs"] = total * time_ns;
+        j["energyPerInstructionPj"] = instructions_completed > 0 ? total / instructions_completed : 0.0;
+        return j;
+    }
 };
 
-// --- (detectHazards is MODIFIED) ---
-// NEW: This function now *only* checks for RAW hazards.
-// Structural hazards are checked separately in the ISSUE stage.
+// --- Hazard detection ---
+// Checks only for RAW hazards; structural hazards are checked in the
+// ISSUE stage.
 bool detectRAWHazards(const Instruction& instr, PipelineState& state,
-                      RegisterScoreboard& scoreboard, int cycle, Statistics& stats) {
+                      RegisterScoreboard& scoreboard, int cycle, Statistics& stats,
+                      const MachineConfig& config) {
     bool hazard = false;
     string reason = "";
+    // A chained vector consumer only waits for the producer's first element group.
+    bool chained = config.vector_chaining && isVectorOp(instr.opcode);
 
-    if (scoreboard.isBusy(instr.src1, cycle)) {
-        hazard = true;
-        reason = "RAW on R" + to_string(instr.src1) +
-                 " (writer: I" + to_string(scoreboard.getWriter(instr.src1)) + ")";
-        #pragma omp atomic
-        stats.raw_hazards++;
-    } else if (scoreboard.isBusy(instr.src2, cycle)) {
-        hazard = true;
-        reason = "RAW on R" + to_string(instr.src2) +
-                 " (writer: I" + to_string(scoreboard.getWriter(instr.src2)) + ")";
-        #pragma omp atomic
-        stats.raw_hazards++;
+    for (int src : {instr.src1, instr.src2, instr.src3}) {
+        int bypass = 0;
+        if (scoreboard.isFpResult(src)) {
+            bypass = isFpOp(instr.opcode) ? config.fp_bypass_latency : config.fp_cross_bypass_latency;
+        }
+        if (scoreboard.isBusy(src, cycle, chained, bypass)) {
+            hazard = true;
+            reason = "RAW on " + registerToString(src) +
+                     " (writer: I" + to_string(scoreboard.getWriter(src)) + ")";
+            #pragma omp atomic
+            stats.raw_hazards++;
+            break;
+        }
     }
 
     if (hazard) {
@@ -238,72 +2007,294 @@ bool detectRAWHazards(const Instruction& instr, PipelineState& state,
     return true; // No hazard
 }
 
-// --- (loadInstructionsFromString and captureCycleState are unchanged) ---
+// --- Run-until conditions and output filters ("query" in the input) ---
+// "until" stops the run after the first cycle meeting any of its
+// conditions; "filter" keeps in "cycles" only the cycles in its window
+// with a matching instruction, and only the matching instructions and
+// stalls of those. Both are evaluated as the run goes, so unmatched
+// cycles are never stored or serialized.
+struct RunQuery {
+    // "until"
+    int until_cycle = 0;            // "cycle": stop at this cycle
+    string until_stall;             // "stallReason"/"stallRegister": first stall whose reason contains it
+    int until_issue = 0;            // "issue": instruction id leaves ISSUE
+    int until_reach = 0;            // "reach": {"instruction", "stage"}: id enters the stage
+    Stage until_reach_stage = EXECUTE;
+    string until_saturated;         // "unitSaturated": {"unit", "cycles"}: every matching
+    int until_saturated_cycles = 1; //   resource busy this many cycles in a row
+
+    // "filter"
+    bool filtering = false;
+    int first_id = 1, last_id = INT_MAX;      // "instructions": [first, last] trace ids
+    vector<Stage> stages;                     // "stages"; empty: all
+    string stall_reason;                      // "stallReason": stalled with a reason containing it
+    string unit;                              // "unit": unit class ("FPU") or resource ("FPU0", "P1")
+    int first_cycle = 1, last_cycle = INT_MAX; // "cycles": [first, last]
+
+    bool hasUntil() const {
+        return until_cycle > 0 || !until_stall.empty() || until_issue > 0 || until_reach > 0 ||
+               !until_saturated.empty();
+    }
+    // A resource matches its own name or its unit class (name less the index).
+    static bool resourceMatches(const string& name, const string& unit) {
+        if (name == unit) return true;
+        size_t end = name.find_last_not_of("0123456789");
+        return end != string::npos && end + 1 < name.size() && name.compare(0, end + 1, unit) == 0;
+    }
+    bool inWindow(int cycle) const { return cycle >= first_cycle && cycle <= last_cycle; }
+    bool filtersEntries() const {
+        return first_id > 1 || last_id < INT_MAX || !stages.empty() || !stall_reason.empty() || !unit.empty();
+    }
+    bool keeps(const Instruction& instr, const PipelineState& state, const ExecutionUnits& units) const {
+        if (instr.id < first_id || instr.id > last_id) return false;
+        if (!stages.empty() && find(stages.begin(), stages.end(), state.current_stage) == stages.end()) return false;
+        if (!stall_reason.empty() && (!state.stalled || state.stall_reason.find(stall_reason) == string::npos)) {
+            return false;
+        }
+        if (!unit.empty()) {
+            const auto& instances = units.getInstances();
+            bool assigned = state.assigned_instance >= 0 && state.assigned_instance < (int)instances.size() &&
+                            resourceMatches(instances[state.assigned_instance].config.name, unit);
+            if (!assigned && unitToString(getExecUnit(instr.opcode)) != unit) return false;
+        }
+        return true;
+    }
+
+    // Call once per cycle after the cycle is captured; returns the met
+    // condition, or "" to keep running. The caller keeps the count of
+    // consecutive saturated cycles in `saturated_run` (start it at 0).
+    string untilMet(int cycle, const vector<Instruction>& instrs, const vector<PipelineState>& states,
+                    size_t num_instructions, const ExecutionUnits& units, int& saturated_run) const {
+        if (until_cycle > 0 && cycle >= until_cycle) return "cycle " + to_string(until_cycle);
+        if (!until_stall.empty()) {
+            for (size_t i = 0; i < instrs.size(); i++) {
+                if (states[i].stalled && states[i].stall_reason.find(until_stall) != string::npos) {
+                    return "stall \"" + states[i].stall_reason + "\" of I" + to_string(instrs[i].id);
+                }
+            }
+        }
+        auto traced = [&](int id) -> const PipelineState* {
+            return (id >= 1 && (size_t)id <= num_instructions) ? &states[id - 1] : nullptr;
+        };
+        if (const PipelineState* s = traced(until_issue); s && s->current_stage > ISSUE) {
+            return "I" + to_string(until_issue) + " issued";
+        }
+        if (const PipelineState* s = traced(until_reach);
+            s && s->current_stage != IDLE && s->current_stage >= until_reach_stage) {
+            return "I" + to_string(until_reach) + " reached " + stageToString(until_reach_stage);
+        }
+        if (!until_saturated.empty()) {
+            vector<char> busy = units.busyAt(cycle);
+            const auto& instances = units.getInstances();
+            bool any = false, all = true;
+            for (size_t k = 0; k < instances.size(); k++) {
+                if (!resourceMatches(instances[k].config.name, until_saturated)) continue;
+                any = true;
+                all = all && busy[k];
+            }
+            saturated_run = (any && all) ? saturated_run + 1 : 0;
+            if (saturated_run >= until_saturated_cycles) {
+                return until_saturated + " saturated for " + to_string(until_saturated_cycles) + " cycles";
+            }
+        }
+        return "";
+    }
+};
+
+// Throws json::exception on a malformed query and invalid_argument on
+// conflicting conditions.
+RunQuery parseRunQuery(const json& j) {
+    RunQuery q;
+    if (j.contains("until")) {
+        const json& u = j["until"];
+        q.until_cycle = max(0, u.value("cycle", 0));
+        // Both name the stall text to wait for, so only one may be given.
+        if (u.contains("stallReason") && u.contains("stallRegister")) {
+            throw invalid_argument("until.stallReason and until.stallRegister cannot be combined.");
+        }
+        q.until_stall = u.value("stallReason", string());
+        // "R5" -> "RAW on R5 (", which "R50" does not match
+        if (u.contains("stallRegister")) q.until_stall = "RAW on " + u["stallRegister"].get<string>() + " (";
+        q.until_issue = max(0, u.value("issue", 0));
+        if (u.contains("reach")) {
+            q.until_reach = max(0, u["reach"].at("instruction").get<int>());
+            Stage stage = stringToStage(u["reach"].value("stage", string("EXECUTE")));
+            if (stage != IDLE) q.until_reach_stage = stage;
+        }
+        if (u.contains("unitSaturated")) {
+            q.until_saturated = u["unitSaturated"].at("unit").get<string>();
+            q.until_saturated_cycles = max(1, u["unitSaturated"].value("cycles", 1));
+        }
+    }
+    if (j.contains("filter")) {
+        const json& f = j["filter"];
+        q.filtering = true;
+        if (f.contains("instructions")) {
+            q.first_id = f["instructions"].at(0).get<int>();
+            q.last_id = f["instructions"].at(1).get<int>();
+        }
+        if (f.contains("stages")) {
+            for (const auto& name : f["stages"]) {
+                Stage stage = stringToStage(name.get<string>());
+                if (stage != IDLE) q.stages.push_back(stage);
+            }
+        }
+        q.stall_reason = f.value("stallReason", string());
+        q.unit = f.value("unit", string());
+        if (f.contains("cycles")) {
+            q.first_cycle = f["cycles"].at(0).get<int>();
+            q.last_cycle = f["cycles"].at(1).get<int>();
+        }
+    }
+    return q;
+}
+
+// Each dynamic instruction gets a static PC: the PC after its
+// predecessor's, or the predecessor's target PC if that was a taken
+// branch. A target at or before the branch names the PC of that trace
+// line, so a loop's back edge sends every iteration through the same
+// PCs; a forward target skips (target - id) slots. RET returns to the
+// slot after its matching CALL, or after line target - 1 if given.
 vector<Instruction> loadInstructionsFromString(const vector<string>& instruction_strings) {
     vector<Instruction> instructions;
     int id = 1;
     int line_num = 0;
+    vector<int> open_calls; // Return ids of CALLs not yet matched by a RET
+    vector<int> open_call_pcs;
+    int next_pc = 1;
 
     for (const auto& line : instruction_strings) {
         line_num++;
         if (line.empty() || line[0] == '#') continue;
 
-        istringstream iss(line);
+        // Operand-value annotations ("@value") may appear anywhere after the opcode.
+        vector<string> operand_values;
+        string body;
+        {
+            istringstream tokens(line);
+            string token;
+            while (tokens >> token) {
+                if (token[0] == '@') operand_values.push_back(token.substr(1));
+                else body += token + " ";
+            }
+        }
+        istringstream iss(body);
         string opcode_str, dest_str, src1_str, src2_str, branch_target_str;
         iss >> opcode_str;
         if (opcode_str.empty()) continue;
 
         Opcode opcode = stringToOpcode(opcode_str);
-        int dest = -1, src1 = -1, src2 = -1;
-        bool is_branch = false;
+        int dest = -1, src1 = -1, src2 = -1, src3 = -1;
         int branch_target = 0;
+        bool taken = false;
 
-        if (opcode == LOAD) {
-            iss >> dest_str >> src1_str;
-            dest = parseRegister(dest_str);
-            src1 = parseRegister(src1_str);
-        } else if (opcode == STORE) {
-            iss >> dest_str >> src1_str;
-            dest = parseRegister(dest_str);
-            src1 = parseRegister(src1_str);
-        } else if (opcode == BEQ || opcode == BNE) {
-            iss >> src1_str >> src2_str >> branch_target_str;
-            src1 = parseRegister(src1_str);
-            src2 = parseRegister(src2_str);
-            branch_target = stoi(branch_target_str);
-            is_branch = true;
-        } else if (opcode == JMP) {
-            iss >> branch_target_str;
-            branch_target = stoi(branch_target_str);
-            is_branch = true;
-        } else {
-            iss >> dest_str >> src1_str >> src2_str;
-            dest = parseRegister(dest_str);
-            src1 = parseRegister(src1_str);
-            src2 = parseRegister(src2_str);
+        // Memory ops take an optional trailing address, e.g. "LOAD R1 R0 0x1000"
+        string addr_str;
+        switch (OPCODE_TABLE[opcode].format) {
+            case FMT_MEM:
+                iss >> dest_str >> src1_str >> addr_str;
+                dest = parseRegister(dest_str);
+                src1 = parseRegister(src1_str);
+                break;
+            case FMT_MEM_SOURCE:
+                // VSTORE Vs Rbase [addr]: reads both the vector and the base register
+                iss >> src1_str >> src2_str >> addr_str;
+                src1 = parseRegister(src1_str);
+                src2 = parseRegister(src2_str);
+                break;
+            case FMT_FMA: {
+                // FMA Rd Ra Rb [Rc]: Rd = Ra * Rb + Rc, accumulating into Rd if Rc is omitted
+                string src3_str;
+                iss >> dest_str >> src1_str >> src2_str >> src3_str;
+                dest = parseRegister(dest_str);
+                src1 = parseRegister(src1_str);
+                src2 = parseRegister(src2_str);
+                src3 = src3_str.empty() ? dest : parseRegister(src3_str);
+                break;
+            }
+            case FMT_COND_BRANCH: {
+                // BEQ Ra Rb target [T|N]: the trace records the actual direction,
+                // not taken (falling through to the next line) by default
+                string outcome_str;
+                iss >> src1_str >> src2_str >> branch_target_str >> outcome_str;
+                src1 = parseRegister(src1_str);
+                src2 = parseRegister(src2_str);
+                branch_target = stoi(branch_target_str);
+                taken = (outcome_str == "T" || outcome_str == "taken");
+                break;
+            }
+            case FMT_JUMP:
+                iss >> branch_target_str;
+                branch_target = stoi(branch_target_str);
+                taken = true;
+                if (opcode == CALL) open_calls.push_back(id + 1);
+                break;
+            case FMT_RETURN:
+                // RET [target]: returns past the matching CALL unless the trace says otherwise
+                iss >> branch_target_str;
+                if (!branch_target_str.empty()) {
+                    branch_target = stoi(branch_target_str);
+                } else if (!open_calls.empty()) {
+                    branch_target = open_calls.back();
+                } else {
+                    branch_target = id + 1;
+                }
+                if (!open_calls.empty()) open_calls.pop_back();
+                taken = true;
+                break;
+            case FMT_RRR:
+                iss >> dest_str >> src1_str >> src2_str;
+                dest = parseRegister(dest_str);
+                src1 = parseRegister(src1_str);
+                src2 = parseRegister(src2_str);
+                break;
         }
+        bool is_branch = hasFlag(opcode, OP_BRANCH);
 
-        instructions.push_back(Instruction(id++, opcode, src1, src2, dest,
-                                          line, is_branch, branch_target));
+        Instruction instr(id, opcode, src1, src2, dest, line, is_branch, branch_target);
+        instr.src3 = src3;
+        instr.taken = taken;
+        instr.pc = next_pc;
+        auto pcOfLine = [&](int line_id) {
+            if (line_id == id) return instr.pc;
+            if (line_id >= 1 && line_id < id) return instructions[line_id - 1].pc;
+            return instr.pc + (line_id - id);
+        };
+        if (opcode == RET) {
+            if (!branch_target_str.empty()) {
+                instr.target_pc = (branch_target >= 2 && branch_target - 1 <= id) ? pcOfLine(branch_target - 1) + 1
+                                                                                  : pcOfLine(branch_target);
+            } else {
+                instr.target_pc = open_call_pcs.empty() ? instr.pc + 1 : open_call_pcs.back() + 1;
+            }
+            if (!open_call_pcs.empty()) open_call_pcs.pop_back();
+        } else if (is_branch) {
+            instr.target_pc = pcOfLine(branch_target);
+            if (opcode == CALL) open_call_pcs.push_back(instr.pc);
+        }
+        next_pc = (is_branch && taken) ? instr.target_pc : instr.pc + 1;
+        id++;
+        instr.operand_values = operand_values;
+        instr.has_address = parseAddress(addr_str, instr.address);
+        instructions.push_back(instr);
     }
     return instructions;
 }
 
+// With a query filter only the instructions it keeps are listed.
 json captureCycleState(int cycle, const vector<Instruction>& instrs,
-                       const vector<PipelineState>& states) {
+                       const vector<PipelineState>& states, const MachineConfig& config,
+                       const RunQuery* filter = nullptr, const ExecutionUnits* units = nullptr) {
     json cycle_data;
     cycle_data["cycle"] = cycle;
 
     map<string, vector<string>> stage_map;
-    stage_map["FETCH"] = {};
-    stage_map["DECODE"] = {};
-    stage_map["ISSUE"] = {};
-    stage_map["EXECUTE"] = {};
-    stage_map["WRITEBACK"] = {};
+    for (Stage s : config.activeStages()) stage_map[stageToString(s)] = {};
 
     vector<json> stalls;
 
     for (size_t i = 0; i < instrs.size(); i++) {
+        if (filter && !filter->keeps(instrs[i], states[i], *units)) continue;
         if (states[i].current_stage != IDLE && states[i].current_stage != COMPLETE) {
             stage_map[stageToString(states[i].current_stage)].push_back(instrs[i].original_string);
         }
@@ -315,117 +2306,1048 @@ json captureCycleState(int cycle, const vector<Instruction>& instrs,
         }
     }
 
-    cycle_data["stages"] = stage_map;
-    cycle_data["stalls"] = stalls;
-    return cycle_data;
+    cycle_data["stages"] = stage_map;
+    cycle_data["stalls"] = stalls;
+    return cycle_data;
+}
+
+// Shifts the instruction ids in RAW stall reasons ("(writer: I12)") by
+// `delta`, so memoized reasons can be stored relative to their block.
+string shiftWriterIds(const string& reason, int delta) {
+    static const string tag = "(writer: I";
+    size_t pos = reason.find(tag);
+    if (pos == string::npos) return reason;
+    size_t start = pos + tag.size();
+    size_t end = reason.find(')', start);
+    int id = stoi(reason.substr(start, end - start));
+    return reason.substr(0, start) + to_string(id + delta) + reason.substr(end);
+}
+
+// --- Level-of-detail timeline ---
+// A zoomed-out view of a long run needs no per-instruction detail. The
+// pyramid sums each cycle's counts into buckets of 1, 16, 256 and 4096
+// cycles: instructions in each stage, stalled instructions by reason and
+// busy cycles per execution resource (a bucket's sums over its "cycles"
+// are the averages). Each level has 1/16 the buckets of the one below,
+// so a view of any zoom and range reads a bounded number of them.
+class TimelinePyramid {
+public:
+    static constexpr int NUM_LEVELS = 4;
+    static constexpr int LEVEL_CYCLES[NUM_LEVELS] = {1, 16, 256, 4096};
+private:
+    struct Bucket {
+        int cycle;                   // First cycle
+        int cycles;
+        vector<long long> occupancy; // Per stage: instruction-cycles
+        vector<long long> stalls;    // Per reason: stalled instruction-cycles
+        vector<long long> busy;      // Per resource: busy cycles
+    };
+    vector<string> stages;
+    vector<int> stage_slot;          // Stage -> index in `stages`, or -1
+    vector<string> units;
+    vector<string> reasons;
+    map<string, size_t> reason_index;
+    vector<vector<Bucket>> levels;
+
+    // RAW reasons name the register and writer; they are grouped as "RAW".
+    size_t reasonIndex(const string& reason) {
+        string category = (reason.rfind("RAW", 0) == 0) ? "RAW" : reason.empty() ? "Other" : reason;
+        auto it = reason_index.find(category);
+        if (it != reason_index.end()) return it->second;
+        reasons.push_back(category);
+        return reason_index[category] = reasons.size() - 1;
+    }
+    static void accumulate(vector<long long>& into, const vector<long long>& from) {
+        if (into.size() < from.size()) into.resize(from.size(), 0);
+        for (size_t k = 0; k < from.size(); k++) into[k] += from[k];
+    }
+public:
+    // One cycle's instructions per stage and stalled instructions per reason.
+    struct Sample {
+        vector<long long> occupancy;
+        vector<long long> stalls;
+    };
+
+    TimelinePyramid(const MachineConfig& config, const vector<ExecutionUnits::Instance>& instances)
+        : stage_slot(NUM_STAGES, -1), levels(NUM_LEVELS) {
+        for (Stage s : config.activeStages()) {
+            stage_slot[s] = stages.size();
+            stages.push_back(stageToString(s));
+        }
+        for (const auto& inst : instances) units.push_back(inst.config.name);
+    }
+
+    // Counts the pipeline as it stands at the end of a cycle.
+    Sample sample(const vector<PipelineState>& states) {
+        Sample sample{vector<long long>(stages.size()), {}};
+        for (const PipelineState& state : states) {
+            if (state.current_stage != IDLE && state.current_stage != COMPLETE && stage_slot[state.current_stage] >= 0) {
+                sample.occupancy[stage_slot[state.current_stage]]++;
+            }
+            if (state.stalled) {
+                size_t r = reasonIndex(state.stall_reason);
+                if (sample.stalls.size() <= r) sample.stalls.resize(r + 1, 0);
+                sample.stalls[r]++;
+            }
+        }
+        return sample;
+    }
+
+    // `busy` is the cycle's busy flag per resource (empty: all idle).
+    void addCycle(int cycle, const Sample& sample, const vector<char>& busy) {
+        vector<long long> busy_cycles(units.size());
+        for (size_t k = 0; k < units.size() && k < busy.size(); k++) busy_cycles[k] = busy[k];
+
+        for (int l = 0; l < NUM_LEVELS; l++) {
+            size_t index = (cycle - 1) / LEVEL_CYCLES[l];
+            vector<Bucket>& buckets = levels[l];
+            while (buckets.size() <= index) {
+                int first = buckets.size() * LEVEL_CYCLES[l] + 1;
+                buckets.push_back({first, 0, vector<long long>(stages.size()), {}, vector<long long>(units.size())});
+            }
+            Bucket& bucket = buckets[index];
+            bucket.cycles++;
+            accumulate(bucket.occupancy, sample.occupancy);
+            accumulate(bucket.stalls, sample.stalls);
+            accumulate(bucket.busy, busy_cycles);
+        }
+    }
+
+    // Buckets list their sums in "stages", "stallReasons" and "units" order.
+    json toJson() const {
+        json j;
+        j["stages"] = stages;
+        j["units"] = units;
+        j["stallReasons"] = reasons;
+        json levels_json = json::array();
+        for (int l = 0; l < NUM_LEVELS; l++) {
+            json buckets_json = json::array();
+            for (const Bucket& bucket : levels[l]) {
+                vector<long long> stalls = bucket.stalls;
+                stalls.resize(reasons.size(), 0);
+                json b;
+                b["cycle"] = bucket.cycle;
+                b["cycles"] = bucket.cycles;
+                b["occupancy"] = bucket.occupancy;
+                b["stalls"] = stalls;
+                b["busy"] = bucket.busy;
+                buckets_json.push_back(b);
+            }
+            json level;
+            level["cyclesPerBucket"] = LEVEL_CYCLES[l];
+            level["buckets"] = buckets_json;
+            levels_json.push_back(level);
+        }
+        j["levels"] = levels_json;
+        return j;
+    }
+};
+
+// --- Basic-block timing memoization ---
+// Loop traces run the same blocks through the same pipeline context over
+// and over. An interval starts at a cycle boundary with fetch at trace
+// index p and lasts until fetch has moved past the block's closing
+// branch. Its key holds everything that decides how those cycles play
+// out, with cycle numbers and instruction ids made relative to the
+// interval: the in-flight instructions, the text of the block, the
+// scoreboard, the execution resources and the fetch unit. A repeated key
+// replays the recorded end state, statistics and per-cycle snapshots
+// instead of simulating the cycles, so results stay cycle-exact.
+//
+// Only the front-end model qualifies; the key holds the I-cache and
+// uop-cache sets the interval fetches from (see FetchUnit::memoKey).
+// Machines with a TLB, data cache, DRAM, speculation or energy model, and
+// traces with CALL/RET, carry history the key does not capture and are
+// never memoized.
+class BlockMemo {
+public:
+    struct Start {
+        size_t p;
+        int base;                  // Cycle before the interval's first cycle
+        int lo;                    // Oldest incomplete instruction
+        size_t end_branch;         // Interval ends once fetch passes this index
+        string key;
+        vector<PipelineState> states; // [lo, p) at the start
+        vector<RegisterScoreboard::RegInfo> regs;
+        vector<ExecutionUnits::Instance> units;
+        FetchUnit::Snapshot fetch;
+        Statistics stats;
+        int completed;
+    };
+    struct Entry {
+        int cycles;
+        int lo;                    // Relative to p
+        vector<PipelineState> exit; // From lo up to the fetch index at exit
+        vector<pair<int, RegisterScoreboard::RegInfo>> regs; // Registers written
+        vector<ExecutionUnits::Instance> units_from, units_to;
+        int rr_next;
+        FetchUnit::Snapshot fetch_from, fetch_to;
+        FetchUnit::FillLog fetch_fills;
+        Statistics stats_from, stats_to;
+        int completed;
+        vector<json> frames;
+        vector<vector<char>> busy;
+        vector<TimelinePyramid::Sample> samples; // When the run builds the timeline
+    };
+    int intervals, hits, misses;
+    long long cycles_replayed;
+
+private:
+    static const size_t MAX_ENTRIES = 4096;
+    static const int GIVE_UP_MISSES = 64; // With no hit yet, stop paying for recording
+    unordered_map<string, Entry> entries;
+    bool recording;
+    Start start;
+    vector<json> frames;
+    vector<vector<char>> busy;
+    vector<TimelinePyramid::Sample> samples;
+
+    static int shift(int cycle, int delta) { return cycle < 0 ? cycle : cycle + delta; }
+    // Moves a state's cycle numbers and writer ids by the given offsets.
+    static PipelineState rebase(PipelineState state, int cycle_delta, int id_delta) {
+        state.issue_cycle = shift(state.issue_cycle, cycle_delta);
+        state.complete_cycle = shift(state.complete_cycle, cycle_delta);
+        state.stall_reason = shiftWriterIds(state.stall_reason, id_delta);
+        return state;
+    }
+
+public:
+    BlockMemo() : intervals(0), hits(0), misses(0), cycles_replayed(0), recording(false) {}
+
+    static bool applies(const MachineConfig& config, const vector<Instruction>& instrs) {
+        if (!config.memoize_blocks || !config.model_front_end || config.model_tlb ||
+            config.model_dcache || config.model_dram || config.model_speculation ||
+            config.model_energy) return false;
+        for (const auto& instr : instrs) {
+            if (instr.opcode == CALL || instr.opcode == RET) return false;
+        }
+        return true;
+    }
+    bool isRecording() const { return recording; }
+    // A trace whose context never repeats (e.g. a backlog that keeps
+    // growing behind a bottleneck) would only pay the recording cost.
+    bool isWorthwhile() const { return hits > 0 || misses < GIVE_UP_MISSES; }
+    size_t endBranch() const { return start.end_branch; }
+
+    string key(size_t p, int base, int lo, size_t end_branch, const vector<Instruction>& instrs,
+               const vector<PipelineState>& states, const RegisterScoreboard& scoreboard,
+               const ExecutionUnits& units, const FetchUnit& fetch, const MachineConfig& config) const {
+        ostringstream key;
+        key << fetch.memoKey(base, end_branch) << '|' << units.memoKey() << '|';
+        // Results older than the longest bypass can no longer stall anyone.
+        int horizon = base - max(config.fp_bypass_latency, config.fp_cross_bypass_latency) - 1;
+        for (int r = 0; r < scoreboard.size(); r++) {
+            RegisterScoreboard::RegInfo reg = scoreboard.save(r);
+            if (reg.ready_cycle <= horizon && reg.chain_ready_cycle <= horizon) {
+                key << '-';
+            } else {
+                key << reg.busy << ',' << reg.writer_id - (int)p << ',' << reg.ready_cycle - base << ','
+                    << reg.chain_ready_cycle - base << ',' << reg.fp_result;
+            }
+            key << ';';
+        }
+        key << '|';
+        for (size_t i = lo; i < p; i++) {
+            const PipelineState& s = states[i];
+            key << (int)i - (int)p << ' ' << instrs[i].original_string << ' ' << s.current_stage << ','
+                << s.cycles_in_stage << ',' << s.stalled << ',' << shiftWriterIds(s.stall_reason, -(int)p) << ','
+                << s.assigned_unit << ',' << s.assigned_instance << ',' << s.exec_latency << ','
+                << s.from_uop_cache << ',' << s.resolved << ',' << s.operands_read << ','
+                << fetch.predictedTaken(instrs[i]) << ';';
+        }
+        key << '|';
+        size_t window_end = min(instrs.size(), end_branch + max(1, config.front_end.width));
+        for (size_t i = p; i < window_end; i++) {
+            key << instrs[i].pc << ' ' << instrs[i].original_string << ',' << fetch.predictedTaken(instrs[i]) << ';';
+        }
+        key << '|' << window_end - p;
+        return key.str();
+    }
+
+    const Entry* find(const string& key) const {
+        auto it = entries.find(key);
+        return it == entries.end() ? nullptr : &it->second;
+    }
+
+    void begin(const string& key, size_t p, int base, int lo, size_t end_branch,
+               const vector<PipelineState>& states, const RegisterScoreboard& scoreboard,
+               const ExecutionUnits& units, FetchUnit& fetch, const Statistics& stats, int completed) {
+        misses++;
+        if (entries.size() >= MAX_ENTRIES) return;
+        recording = true;
+        start.p = p;
+        start.base = base;
+        start.lo = lo;
+        start.end_branch = end_branch;
+        start.key = key;
+        start.states.assign(states.begin() + lo, states.begin() + p);
+        start.regs.clear();
+        for (int r = 0; r < scoreboard.size(); r++) start.regs.push_back(scoreboard.save(r));
+        start.units = units.getInstances();
+        start.fetch = fetch.snapshot();
+        fetch.startLog();
+        start.stats = stats;
+        start.completed = completed;
+        frames.clear();
+        busy.clear();
+        samples.clear();
+    }
+    // `sample` is null unless the run builds the timeline.
+    void recordCycle(const json& frame, vector<char> busy_now, const TimelinePyramid::Sample* sample) {
+        if (!recording) return;
+        frames.push_back(frame);
+        busy.push_back(move(busy_now));
+        if (sample) samples.push_back(*sample);
+    }
+
+    void finish(int cycle, const vector<PipelineState>& states, const RegisterScoreboard& scoreboard,
+                const ExecutionUnits& units, FetchUnit& fetch, const Statistics& stats, int completed) {
+        recording = false;
+        intervals++;
+        int p = start.p, base = start.base;
+        Entry entry;
+        entry.cycles = cycle - base;
+        entry.lo = start.lo - p;
+        for (size_t i = start.lo; i < fetch.nextIndex(); i++) {
+            PipelineState s = rebase(states[i], -base, -p);
+            if (i < start.p) s.total_cycles -= start.states[i - start.lo].total_cycles;
+            entry.exit.push_back(s);
+        }
+        for (int r = 0; r < scoreboard.size(); r++) {
+            RegisterScoreboard::RegInfo reg = scoreboard.save(r), prior = start.regs[r];
+            if (reg.busy == prior.busy && reg.writer_id == prior.writer_id && reg.ready_cycle == prior.ready_cycle &&
+                reg.chain_ready_cycle == prior.chain_ready_cycle && reg.fp_result == prior.fp_result) continue;
+            reg.writer_id -= p;
+            reg.ready_cycle -= base;
+            reg.chain_ready_cycle -= base;
+            entry.regs.push_back({r, reg});
+        }
+        entry.units_from = start.units;
+        entry.units_to = units.getInstances();
+        for (auto& inst : entry.units_to) inst.last_issue_cycle -= base;
+        entry.rr_next = units.roundRobinNext();
+        entry.fetch_from = start.fetch;
+        entry.fetch_to = fetch.snapshot();
+        entry.fetch_to.stall_until -= base;
+        entry.fetch_fills = fetch.takeLog();
+        entry.stats_from = start.stats;
+        entry.stats_to = stats;
+        entry.completed = completed - start.completed;
+        for (auto& frame : frames) {
+            frame["cycle"] = frame["cycle"].get<int>() - base;
+            for (auto& stall : frame["stalls"]) {
+                stall["reason"] = shiftWriterIds(stall["reason"].get<string>(), -p);
+            }
+        }
+        entry.frames = move(frames);
+        entry.busy = move(busy);
+        entry.samples = move(samples);
+        entries.emplace(start.key, move(entry));
+    }
+
+    // Applies a recorded interval at fetch index p, after cycle `base`.
+    void replay(const Entry& entry, size_t p, int base, vector<PipelineState>& states,
+                RegisterScoreboard& scoreboard, ExecutionUnits& units, FetchUnit& fetch,
+                Statistics& stats, int& completed, vector<json>& cycle_history, TimelinePyramid* pyramid) {
+        hits++;
+        cycles_replayed += entry.cycles;
+        for (size_t k = 0; k < entry.exit.size(); k++) {
+            size_t i = p + entry.lo + k;
+            PipelineState s = rebase(entry.exit[k], base, p);
+            s.total_cycles += states[i].total_cycles;
+            s.static_index = i;
+            states[i] = s;
+        }
+        for (const auto& [r, recorded] : entry.regs) {
+            RegisterScoreboard::RegInfo reg = recorded;
+            reg.writer_id += p;
+            reg.ready_cycle += base;
+            reg.chain_ready_cycle += base;
+            scoreboard.set(r, reg);
+        }
+        units.replay(entry.units_from, entry.units_to, entry.rr_next, base, entry.busy, base + 1);
+        fetch.replay(entry.fetch_from, entry.fetch_to, base, entry.fetch_fills);
+        stats.addDelta(entry.stats_from, entry.stats_to);
+        completed += entry.completed;
+        for (const auto& recorded : entry.frames) {
+            json frame = recorded;
+            frame["cycle"] = recorded["cycle"].get<int>() + base;
+            for (auto& stall : frame["stalls"]) {
+                stall["reason"] = shiftWriterIds(stall["reason"].get<string>(), p);
+            }
+            cycle_history.push_back(move(frame));
+        }
+        for (size_t c = 0; pyramid && c < entry.samples.size(); c++) {
+            pyramid->addCycle(base + 1 + c, entry.samples[c], entry.busy[c]);
+        }
+    }
+
+    json toJson() const {
+        json j;
+        j["intervals"] = intervals;
+        j["hits"] = hits;
+        j["misses"] = misses;
+        j["cyclesReplayed"] = cycles_replayed;
+        j["entries"] = entries.size();
+        return j;
+    }
+};
+
+// --- Interval-analysis fast model ---
+// One linear pass over the trace, no cycle loop. The run time is bounded
+// below by three limits: dispatch (front-end width, taken-branch bubbles
+// and I-cache misses), execution resources (busy cycles per unit or port,
+// balanced greedily) and the dataflow critical path (latencies including
+// TLB/cache/DRAM time from a linear replay of the memory models). The
+// estimate is the largest bound plus pipeline fill and a refill penalty
+// per mispredicted branch or return.
+json estimateInterval(const vector<Instruction>& instructions, const MachineConfig& config) {
+    const int n = instructions.size();
+    // Cycles until the first instruction can issue (fetch starts in cycle 1).
+    const int fill = 1 + config.stageDepth(FETCH) + config.stageDepth(DECODE) + config.stageDepth(ISSUE);
+    const int tail = config.stageDepth(REGREAD) + config.stageDepth(WRITEBACK) + config.stageDepth(COMMIT);
+
+    // Dispatch: the cycle (after the first) each instruction is fetched.
+    // Without a front-end model everything is fetched at once.
+    vector<long long> fetched(n, 0);
+    long long dispatch = 0;
+    if (config.model_front_end) {
+        const FrontEndConfig& fe = config.front_end;
+        CacheModel icache(fe.icache);
+        long long cycle = 0;
+        int in_group = 0;
+        uint64_t group_block = 0;
+        for (int i = 0; i < n; i++) {
+            const Instruction& instr = instructions[i];
+            uint64_t addr = (uint64_t)(instr.pc - 1) * fe.instruction_bytes;
+            if (in_group > 0 && addr / fe.block_bytes != group_block) { cycle++; in_group = 0; }
+            if (in_group == 0) {
+                group_block = addr / fe.block_bytes;
+                if (!icache.access(addr)) cycle += max(1, fe.icache.miss_latency);
+            }
+            fetched[i] = cycle;
+            bool taken = isUnconditionalBranch(instr.opcode) || (instr.is_branch && instr.target_pc <= instr.pc);
+            if (++in_group == fe.width || taken) {
+                cycle += 1 + (taken ? fe.taken_branch_bubble : 0);
+                in_group = 0;
+            }
+        }
+        dispatch = (n > 0) ? fetched[n - 1] + 1 : 0;
+    }
+
+    // Mispredictions, replaying the predictor and return-address stack in
+    // program order (trained immediately rather than at resolution).
+    int mispredictions = 0;
+    if (config.model_front_end || config.model_speculation) {
+        BranchPredictor predictor(config.predictor);
+        ReturnAddressStack ras(config.front_end.ras_entries);
+        for (int i = 0; i < n; i++) {
+            const Instruction& instr = instructions[i];
+            if (instr.opcode == CALL) {
+                ras.push(instr.pc + 1);
+            } else if (instr.opcode == RET) {
+                if (ras.pop() != instr.target_pc) mispredictions++;
+            } else if (config.model_speculation && instr.is_branch && !isUnconditionalBranch(instr.opcode)) {
+                if (predictor.predict(instr) != instr.taken) mispredictions++;
+                predictor.update(instr, instr.taken);
+            }
+        }
+    }
+    int mispredict_penalty = config.frontEndDepth() + 1;
+
+    // Dataflow critical path and resource occupancy.
+    ExecutionUnits units(config);
+    const auto& instances = units.getInstances();
+    vector<long long> occupancy(instances.size(), 0);
+    vector<long long> ready(NUM_SCALAR_REGS + NUM_VECTOR_REGS, 0);
+    vector<long long> chain_ready(ready.size(), 0);
+    vector<bool> fp_result(ready.size(), false);
+    DataTLB dtlb(config.tlb);
+    DataCacheConfig dcache_config = config.dcache;
+    int dram_latency = config.dram.t_rcd + config.dram.t_cas + config.dram.t_burst;
+    if (config.model_dram) dcache_config.geometry.miss_latency = dram_latency;
+    DataCache dcache(dcache_config);
+    long long critical_path = 0, memory_cycles = 0;
+
+    for (int i = 0; i < n; i++) {
+        const Instruction& instr = instructions[i];
+        Opcode op = instr.opcode;
+        bool chained = config.vector_chaining && isVectorOp(op);
+        long long start = fetched[i];
+        for (int src : {instr.src1, instr.src2, instr.src3}) {
+            if (src < 0 || src >= (int)ready.size()) continue;
+            int bypass = fp_result[src] ? (isFpOp(op) ? config.fp_bypass_latency : config.fp_cross_bypass_latency) : 0;
+            start = max(start, (chained ? chain_ready[src] : ready[src]) + bypass);
+        }
+
+        int memory = 0;
+        if (instr.has_address) {
+            if (config.model_tlb) memory += dtlb.translate(instr.address);
+            if (config.model_dcache) {
+                memory += dcache.access((uint64_t)(instr.pc - 1) * config.front_end.instruction_bytes, instr.address,
+                                        fill + start + memory, isStoreOp(op)).extra;
+            } else if (config.model_dram) {
+                memory += dram_latency;
+            }
+        }
+        memory_cycles += memory;
+        int latency = getInstructionLatency(instr, config) + memory;
+        long long done = start + config.stageDepth(REGREAD) + latency;
+        if (instr.dest >= 0 && instr.dest < (int)ready.size()) {
+            ready[instr.dest] = done;
+            chain_ready[instr.dest] = done - config.chainLead(op);
+            fp_result[instr.dest] = isFpOp(op);
+        }
+        critical_path = max(critical_path, done);
+
+        if (getExecUnit(op) == ANY_UNIT) continue;
+        int best = -1;
+        for (size_t k = 0; k < instances.size(); k++) {
+            if (!instances[k].config.supports(op)) continue;
+            if (best < 0 || occupancy[k] < occupancy[best]) best = k;
+        }
+        if (best < 0) continue;
+        occupancy[best] += ExecutionUnits::blocksInstance(instances[best], op)
+                         ? config.stageDepth(REGREAD) + latency + config.stageDepth(WRITEBACK) : 1;
+    }
+    long long resources = occupancy.empty() ? 0 : *max_element(occupancy.begin(), occupancy.end());
+
+    // Bounds share the pipeline fill; the critical path already includes
+    // its own latencies, the throughput bounds add the drain of the last op.
+    long long dataflow_bound = critical_path + config.stageDepth(WRITEBACK) + config.stageDepth(COMMIT);
+    long long resource_bound = resources + tail;
+    long long dispatch_bound = dispatch + tail;
+    long long bound = max({dataflow_bound, resource_bound, dispatch_bound});
+    string bottleneck = (bound == dataflow_bound) ? "dataflow" : (bound == resource_bound) ? "resources" : "dispatch";
+    long long penalty = (long long)mispredictions * mispredict_penalty;
+    long long total = fill + bound + penalty;
+
+    json j;
+    j["totalCycles"] = total;
+    j["instructions"] = n;
+    j["ipc"] = total > 0 ? (double)n / total : 0.0;
+    j["bottleneck"] = bottleneck;
+    j["fillCycles"] = fill;
+    j["dispatchBoundCycles"] = dispatch_bound;
+    j["resourceBoundCycles"] = resource_bound;
+    j["criticalPathCycles"] = dataflow_bound;
+    j["memoryCycles"] = memory_cycles;
+    j["mispredictions"] = mispredictions;
+    j["mispredictionPenaltyCycles"] = penalty;
+    return j;
+}
+
+// --- OpenMP thread profiling ---
+// Where the cycle loop's wall time goes when it runs on a team of
+// threads, collected when config "profileThreads" is set. A parallel
+// region costs its wall time on every thread of the team; the part a
+// thread did not spend in loop iterations went to fork/join and to
+// waiting at the region's closing barrier.
+class ThreadProfile {
+private:
+    using Clock = chrono::steady_clock;
+    struct alignas(64) ThreadTime { long long busy_ns = 0; }; // One cache line per thread
+
+    int threads;
+    vector<ThreadTime> per_thread;
+    long long regions;
+    long long region_ns;           // Wall time inside parallel regions
+    long long critical_entries;
+    long long critical_wait_ns;    // Summed over threads: waiting to enter ExecUnitRelease
+    long long critical_hold_ns;    // Summed over threads: inside ExecUnitRelease
+
+    static long long since(Clock::time_point start) {
+        return chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count();
+    }
+public:
+    explicit ThreadProfile(int team_size)
+        : threads(max(1, team_size)), per_thread(threads), regions(0), region_ns(0),
+          critical_entries(0), critical_wait_ns(0), critical_hold_ns(0) {}
+
+    // Runs body(i) for i in [0, n) on the team, as the pipeline stages'
+    // `parallel for schedule(dynamic)` loops do.
+    template <class Body>
+    void parallelFor(int n, Body body) {
+        Clock::time_point start = Clock::now();
+        #pragma omp parallel
+        {
+            Clock::time_point thread_start = Clock::now();
+            #pragma omp for schedule(dynamic) nowait
+            for (int i = 0; i < n; i++) body(i);
+            int t = omp_get_thread_num();
+            if (t < threads) per_thread[t].busy_ns += since(thread_start);
+        }
+        regions++;
+        region_ns += since(start);
+    }
+
+    // Runs body inside the ExecUnitRelease critical section.
+    template <class Body>
+    void critical(Body body) {
+        Clock::time_point start = Clock::now();
+        #pragma omp critical(ExecUnitRelease)
+        {
+            Clock::time_point entered = Clock::now();
+            body();
+            critical_entries++;
+            critical_wait_ns += chrono::duration_cast<chrono::nanoseconds>(entered - start).count();
+            critical_hold_ns += since(entered);
+        }
+    }
+
+    json toJson(double total_ms) const {
+        const double NS_PER_MS = 1e6;
+        long long busy_ns = 0;
+        json busy = json::array();
+        for (const auto& t : per_thread) {
+            busy_ns += t.busy_ns;
+            busy.push_back(t.busy_ns / NS_PER_MS);
+        }
+        long long team_ns = region_ns * threads;
+        json j;
+        j["threads"] = threads;
+        j["parallelRegions"] = regions;
+        j["totalMs"] = total_ms;
+        j["parallelMs"] = region_ns / NS_PER_MS;
+        j["serialMs"] = max(0.0, total_ms - region_ns / NS_PER_MS);
+        j["barrierMs"] = max(0LL, team_ns - busy_ns) / NS_PER_MS; // Thread-ms idle at region ends
+        j["busyMsPerThread"] = busy;
+        j["parallelEfficiency"] = team_ns > 0 ? (double)busy_ns / team_ns : 0.0;
+        j["criticalEntries"] = critical_entries;
+        j["criticalWaitMs"] = critical_wait_ns / NS_PER_MS;
+        j["criticalHoldMs"] = critical_hold_ns / NS_PER_MS;
+        return j;
+    }
+};
+
+// The pipeline stages' parallel loops and critical sections, timed
+// when `profile` is set.
+template <class Body>
+void parallelFor(ThreadProfile* profile, int n, Body body) {
+    if (profile) {
+        profile->parallelFor(n, body);
+        return;
+    }
+    #pragma omp parallel for schedule(dynamic)
+    for (int i = 0; i < n; i++) body(i);
 }
 
+template <class Body>
+void criticalExecUnitRelease(ThreadProfile* profile, Body body) {
+    if (profile) {
+        profile->critical(body);
+        return;
+    }
+    #pragma omp critical(ExecUnitRelease)
+    body();
+}
 
-int main() {
-    omp_set_num_threads(4);
+// --- Simulation engine ---
+// Which models a compiled engine supports. The model switches are fixed
+// for a run, so every combination of them is instantiated: a model whose
+// policy flag is false is compiled out of the cycle loop, and
+// runSimulation() picks the engine whose flags match the config. Only
+// the TLB, data cache and DRAM switches inside the memory model remain
+// runtime checks.
+template <bool FrontEnd, bool Memory, bool Speculation, bool Energy>
+struct EnginePolicy {
+    static constexpr bool front_end = FrontEnd;     // Fetch unit, return-address stack, memoization
+    static constexpr bool memory = Memory;          // TLB, data cache and DRAM
+    static constexpr bool speculation = Speculation; // Branch predictor and wrong-path fetch
+    static constexpr bool energy = Energy;
+};
 
-    json input_json;
-    try {
-        cin >> input_json;
-    } catch (json::parse_error& e) {
-        json error_json;
-        error_json["error"] = "Invalid JSON input.";
-        error_json["details"] = e.what();
-        cout << error_json.dump() << endl;
-        return 1;
-    }
+// Runs the cycle loop and returns the "result" object (stats, stages,
+// utilization and the per-cycle history). A query may end the run early
+// and trims the history to the cycles it matches.
+template <class Policy>
+json simulate(vector<Instruction> instructions, const MachineConfig& config, const RunQuery* query) {
+    const bool model_front_end = Policy::front_end && config.model_front_end;
+    const bool model_tlb = Policy::memory && config.model_tlb;
+    const bool model_dcache = Policy::memory && config.model_dcache;
+    const bool model_dram = Policy::memory && config.model_dram;
+    const bool model_speculation = Policy::speculation && config.model_speculation;
+    const bool model_energy = Policy::energy && config.model_energy;
+    // Stage depths and the register-file and result-bus limits are also
+    // fixed for the run; the cycle loop reads these copies.
+    const array<int, NUM_STAGES> depth = config.stage_depth;
+    const int rf_read_ports = config.rf_read_ports;
+    const int rf_write_ports = config.rf_write_ports;
+    const int result_buses = config.result_buses;
 
-    vector<string> instruction_strings = input_json["instructions"].get<vector<string>>();
-    vector<Instruction> instructions = loadInstructionsFromString(instruction_strings);
+    // Wrong-path instructions are appended past the traced ones while a
+    // misprediction is outstanding and removed again when it resolves.
+    const size_t num_instructions = instructions.size();
+    vector<PipelineState> states(num_instructions);
+    for (size_t i = 0; i < num_instructions; i++) states[i].static_index = i;
+    RegisterScoreboard scoreboard(NUM_SCALAR_REGS + NUM_VECTOR_REGS);
+    ExecutionUnits exec_units(config);
+    EnergyModel energy(config.energy);
+    BranchPredictor predictor(config.predictor);
+    FetchUnit fetch_unit(config.front_end, instructions, model_speculation ? &predictor : nullptr);
+    DataTLB dtlb(config.tlb);
+    DramController dram(config.dram);
+    DataCache dcache(config.dcache, model_dram ? &dram : nullptr);
+    vector<int> waiting_on_dram; // Indices of issued memory ops whose data is still in DRAM
 
-    if (instructions.empty()) {
-        json error_json;
-        error_json["error"] = "No instructions loaded from input.";
-        cout << error_json.dump() << endl;
-        return 1;
+    // Branch prediction state. The return-address stack is part of the
+    // front end, and of speculative fetch when that is modelled.
+    const bool model_ras = model_front_end || model_speculation;
+    ReturnAddressStack ras(config.front_end.ras_entries);
+    size_t fetched_upto = 0;      // Traced instructions fetched so far (fetch is in order)
+    int mispredicted_branch = -1; // Trace index of the outstanding mispredicted branch
+    int wrong_path_pc = 0;        // Next static PC fetched down the wrong path, 0 if none
+    int next_wrong_path_id = num_instructions + 1;
+    // The wrong path is fetched from the code the trace shows at each
+    // static PC (its first traced instruction there).
+    unordered_map<int, size_t> code_at_pc;
+    if (model_speculation) {
+        for (size_t i = num_instructions; i-- > 0;) code_at_pc[instructions[i].pc] = i;
     }
+    map<int, RegisterScoreboard::RegInfo> spec_checkpoints; // Wrong-path op -> its dest before it issued
 
-    vector<PipelineState> states(instructions.size());
-    RegisterScoreboard scoreboard(32);
-    ExecutionUnits exec_units;
     Statistics stats;
     vector<json> cycle_history;
 
     int cycle = 0;
     int completed = 0;
-    const int MAX_CYCLES = 500;
+    const int MAX_CYCLES = config.max_cycles;
+
+    // Basic-block memoization: each interval ends at the first branch at
+    // or after the fetch index it started from (or at the trace's end).
+    BlockMemo memo;
+    // Queries look at every cycle, so they run without memoization.
+    const bool memoize = !query && BlockMemo::applies(config, instructions);
+    vector<size_t> block_end(num_instructions);
+    for (size_t i = num_instructions; i-- > 0;) {
+        block_end[i] = (instructions[i].is_branch || i + 1 == num_instructions) ? i : block_end[i + 1];
+    }
+    size_t memo_lo = 0;                      // Oldest incomplete instruction
+    size_t memo_last_start = num_instructions; // Fetch index the last interval started from
+
+    TimelinePyramid pyramid(config, exec_units.getInstances());
+    string stop_condition; // The "until" condition that ended the run
+    int saturated_run = 0; // Consecutive cycles meeting "unitSaturated"
+
+    ThreadProfile thread_profile(omp_get_max_threads());
+    ThreadProfile* profile = config.profile_threads ? &thread_profile : nullptr;
+    auto loop_start = chrono::steady_clock::now();
 
     // Main simulation loop
-    while (completed < instructions.size() && cycle < MAX_CYCLES) {
+    while (completed < num_instructions && cycle < MAX_CYCLES) {
+        if (memoize) {
+            size_t p = fetch_unit.nextIndex();
+            if (memo.isRecording() && p > memo.endBranch()) {
+                memo.finish(cycle, states, scoreboard, exec_units, fetch_unit, stats, completed);
+            }
+            if (!memo.isRecording() && memo.isWorthwhile() && p < num_instructions && p != memo_last_start) {
+                memo_last_start = p;
+                while (memo_lo < p && states[memo_lo].current_stage == COMPLETE) memo_lo++;
+                string key = memo.key(p, cycle, memo_lo, block_end[p], instructions, states,
+                                      scoreboard, exec_units, fetch_unit, config);
+                const BlockMemo::Entry* entry = memo.find(key);
+                if (entry && cycle + entry->cycles <= MAX_CYCLES) {
+                    memo.replay(*entry, p, cycle, states, scoreboard, exec_units, fetch_unit,
+                                stats, completed, cycle_history, config.timeline_pyramid ? &pyramid : nullptr);
+                    cycle += entry->cycles;
+                    continue;
+                }
+                if (!entry) {
+                    memo.begin(key, p, cycle, memo_lo, block_end[p], states, scoreboard,
+                               exec_units, fetch_unit, stats, completed);
+                }
+            }
+        }
         cycle++;
-        
-        // --- (Writeback and Execute are unchanged) ---
 
-        // WriteBack stage (parallel)
-        #pragma omp parallel for schedule(dynamic)
+        // DRAM: schedule requests, then give ops whose data has arrived
+        // their final EXECUTE latency and result time.
+        if (model_dram) {
+            dram.tick(cycle);
+            for (size_t w = 0; w < waiting_on_dram.size();) {
+                int i = waiting_on_dram[w];
+                int done = dram.completionCycle(states[i].mem_request);
+                if (done < 0) { w++; continue; }
+                // Data arrives `done - issue_cycle` cycles after issue; the
+                // op's own latency (and any TLB time already charged) follows.
+                int final_latency = max(states[i].exec_latency,
+                                        done - states[i].issue_cycle + getInstructionLatency(instructions[i], config));
+                int wait = final_latency - states[i].exec_latency;
+                states[i].exec_latency = final_latency;
+                states[i].mem_request = -1;
+                stats.memory_stall_cycles += wait;
+                if (model_dcache) dcache.stall_cycles += wait;
+                int ready = states[i].issue_cycle + depth[REGREAD] + states[i].exec_latency;
+                scoreboard.setReady(instructions[i].dest, instructions[i].id, ready,
+                                    ready - config.chainLead(instructions[i].opcode));
+                waiting_on_dram[w] = waiting_on_dram.back();
+                waiting_on_dram.pop_back();
+            }
+        }
+
+        // Commit stage: retires in program order once an instruction has
+        // spent the commit depth here and every older instruction is done.
+        bool older_retired = true;
         for (int i = 0; i < instructions.size(); i++) {
-            if (states[i].current_stage == WRITEBACK) {
-                scoreboard.clearBusy(instructions[i].dest);
+            if (states[i].current_stage == COMMIT) {
+                states[i].cycles_in_stage++;
+                if (older_retired && states[i].cycles_in_stage >= depth[COMMIT]) {
+                    states[i].current_stage = COMPLETE;
+                    states[i].complete_cycle = cycle;
+                    completed++;
+                }
+            }
+            if (states[i].current_stage != COMPLETE) older_retired = false;
+        }
+
+        // Register-file write ports: results finishing WRITEBACK this cycle
+        // are granted ports oldest first; the rest wait in WRITEBACK.
+        if (rf_write_ports > 0) {
+            int ports_left = rf_write_ports;
+            for (int i = 0; i < instructions.size(); i++) {
+                if (states[i].current_stage != WRITEBACK || instructions[i].dest < 0 ||
+                    states[i].cycles_in_stage + 1 < depth[WRITEBACK]) continue;
+                states[i].stalled = (ports_left == 0);
+                if (ports_left > 0) {
+                    ports_left--;
+                } else {
+                    states[i].stall_reason = "Structural - RF write port busy";
+                    #pragma omp atomic
+                    stats.rf_write_port_stalls++;
+                    #pragma omp atomic
+                    stats.structural_hazards++;
+                    #pragma omp atomic
+                    stats.total_stalls++;
+                }
+            }
+        }
+
+        // WriteBack stage (parallel)
+        parallelFor(profile, instructions.size(), [&](int i) {
+            if (states[i].current_stage == WRITEBACK && !states[i].stalled &&
+                ++states[i].cycles_in_stage >= depth[WRITEBACK]) {
+                scoreboard.clearBusy(instructions[i].dest, instructions[i].id);
                 if (states[i].assigned_unit != ANY_UNIT) {
-                    #pragma omp critical(ExecUnitRelease)
-                    {
-                        exec_units.release(states[i].assigned_unit);
+                    criticalExecUnitRelease(profile, [&] {
+                        exec_units.release(states[i].assigned_instance, instructions[i].opcode);
+                    });
+                }
+                states[i].cycles_in_stage = 0;
+                if (depth[COMMIT] > 0 && !states[i].wrong_path) {
+                    states[i].current_stage = COMMIT;
+                } else {
+                    // Wrong-path ops finish here and wait, uncounted, to be squashed.
+                    states[i].current_stage = COMPLETE;
+                    states[i].complete_cycle = cycle;
+                    if (!states[i].wrong_path) {
+                        #pragma omp atomic
+                        completed++;
                     }
                 }
-                states[i].current_stage = COMPLETE;
-                states[i].complete_cycle = cycle;
-                #pragma omp atomic
-                completed++;
+            }
+        });
+
+        // Result buses: instructions finishing EXECUTE this cycle with a
+        // result to broadcast are granted buses oldest first; the rest hold
+        // their unit and delay their result by a cycle.
+        if (result_buses > 0) {
+            int buses_left = result_buses;
+            for (int i = 0; i < instructions.size(); i++) {
+                if (states[i].current_stage != EXECUTE || instructions[i].dest < 0 ||
+                    states[i].mem_request >= 0 ||
+                    states[i].cycles_in_stage + 1 < states[i].exec_latency) continue;
+                states[i].stalled = (buses_left == 0);
+                if (buses_left > 0) {
+                    buses_left--;
+                } else {
+                    states[i].stall_reason = "Structural - result bus busy";
+                    scoreboard.delayReady(instructions[i].dest, instructions[i].id, 1);
+                    #pragma omp atomic
+                    stats.result_bus_stalls++;
+                    #pragma omp atomic
+                    stats.structural_hazards++;
+                    #pragma omp atomic
+                    stats.total_stalls++;
+                }
             }
         }
-        #pragma omp barrier
 
         // Execute stage (parallel with latency)
-        #pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < instructions.size(); i++) {
-            if (states[i].current_stage == EXECUTE) {
+        parallelFor(profile, instructions.size(), [&](int i) {
+            if (states[i].current_stage == EXECUTE && !states[i].stalled) {
                 states[i].cycles_in_stage++;
-                int required_cycles = getLatency(instructions[i].opcode);
+                int required_cycles = states[i].exec_latency;
 
-                if (states[i].cycles_in_stage >= required_cycles) {
+                if (states[i].cycles_in_stage >= required_cycles && states[i].mem_request < 0) {
                     states[i].current_stage = WRITEBACK;
                     states[i].cycles_in_stage = 0;
                 }
             }
+        });
+
+        // Branches resolve as they leave EXECUTE: the predictor trains on
+        // the actual outcome and a misprediction squashes the wrong path
+        // (or, without speculation, just lets fetch continue).
+        if (model_ras) {
+            for (size_t i = 0; i < num_instructions; i++) {
+                if (!instructions[i].is_branch || states[i].resolved ||
+                    states[i].current_stage < WRITEBACK) continue;
+                states[i].resolved = true;
+                stats.branches_resolved++;
+                predictor.update(instructions[i], instructions[i].taken);
+                if ((int)i != mispredicted_branch) continue;
+
+                stats.branch_mispredictions++;
+                // Youngest first, so each register unwinds to its state before the branch.
+                for (size_t k = instructions.size(); k-- > num_instructions;) {
+                    PipelineState& squashed = states[k];
+                    if (squashed.current_stage >= REGREAD && squashed.current_stage <= WRITEBACK &&
+                        squashed.assigned_unit != ANY_UNIT) {
+                        exec_units.release(squashed.assigned_instance, instructions[k].opcode);
+                    }
+                    auto checkpoint = spec_checkpoints.find(k);
+                    if (checkpoint != spec_checkpoints.end()) {
+                        RegisterScoreboard::RegInfo prior = checkpoint->second;
+                        // A traced writer that finished meanwhile could not clear its register.
+                        int writer = prior.writer_id - 1;
+                        if (prior.busy && writer >= 0 && writer < (int)num_instructions &&
+                            states[writer].current_stage > WRITEBACK) {
+                            prior.busy = false;
+                        }
+                        scoreboard.restore(instructions[k].dest, instructions[k].id, prior);
+                    }
+                    stats.wrong_path_squashed++;
+                }
+                instructions.erase(instructions.begin() + num_instructions, instructions.end());
+                states.erase(states.begin() + num_instructions, states.end());
+                spec_checkpoints.clear();
+                waiting_on_dram.erase(remove_if(waiting_on_dram.begin(), waiting_on_dram.end(),
+                                                [&](int w) { return w >= (int)num_instructions; }),
+                                      waiting_on_dram.end());
+                mispredicted_branch = -1;
+            }
         }
-        #pragma omp barrier
 
+        // Register-read stage: issued instructions read operands before EXECUTE.
+        for (int i = 0; i < instructions.size(); i++) {
+            if (states[i].current_stage == REGREAD &&
+                ++states[i].cycles_in_stage >= depth[REGREAD]) {
+                states[i].current_stage = EXECUTE;
+                states[i].cycles_in_stage = 0;
+            }
+        }
 
-        // -----------------------------------------------------------------
-        // LOGIC FIX: ISSUE stage now checks for BOTH RAW and STRUCTURAL
-        // hazards before issuing.
-        // -----------------------------------------------------------------
+        // Issue stage: an instruction issues once it has no RAW hazard and
+        // its execution resource, read ports and DRAM queue are free.
+        int read_ports_left = rf_read_ports;
         for (int i = 0; i < instructions.size(); i++) {
             if (states[i].current_stage == ISSUE) {
-                
+                // A deeper issue stage holds instructions for its full
+                // depth before they become candidates for selection.
+                if (++states[i].cycles_in_stage < depth[ISSUE]) continue;
+
                 // Step 1: Check for RAW (data) hazards.
                 // This function will set stall state if a RAW hazard exists.
-                if (detectRAWHazards(instructions[i], states[i], scoreboard, cycle, stats)) {
+                if (detectRAWHazards(instructions[i], states[i], scoreboard, cycle, stats, config)) {
                     
                     // Step 2: NO RAW hazard. Now check for STRUCTURAL hazard.
-                    ExecUnit unit = getExecUnit(instructions[i].opcode);
-                    if (exec_units.isAvailable(unit)) {
+                    Opcode op = instructions[i].opcode;
+                    ExecUnit unit = getExecUnit(op);
+                    // Operands beyond the free read ports are read over
+                    // the following cycles; the op issues once all are read.
+                    int reads_needed = instructions[i].registerReads() - states[i].operands_read;
+                    bool read_ports_ok = rf_read_ports == 0 || reads_needed <= read_ports_left;
+                    // A memory op that will go to DRAM needs room in its channel queue.
+                    bool dram_queue_ok = true;
+                    if (model_dram && instructions[i].has_address &&
+                        !(model_dcache && dcache.contains(instructions[i].address))) {
+                        dram_queue_ok = dram.canAccept(instructions[i].address);
+                    }
+                    if (exec_units.isAvailable(unit, op, cycle) && read_ports_ok && dram_queue_ok) {
                         
                         // Step 3: All clear! Allocate and move to EXECUTE.
-                        exec_units.allocate(unit);
-                        states[i].current_stage = EXECUTE;
+                        read_ports_left -= reads_needed;
+                        states[i].assigned_instance = exec_units.allocate(unit, op, cycle);
+                        states[i].current_stage = (depth[REGREAD] > 0) ? REGREAD : EXECUTE;
                         states[i].assigned_unit = unit;
                         states[i].cycles_in_stage = 0;
                         states[i].issue_cycle = cycle;
                         states[i].stalled = false; // Clear any old stall
 
-                        int ready_at_cycle = cycle + getLatency(instructions[i].opcode);
-                        scoreboard.markBusy(instructions[i].dest, instructions[i].id, ready_at_cycle);
+                        // Address translation happens before the access itself.
+                        int translation = 0;
+                        MemAccess mem = {0, -1};
+                        if (instructions[i].has_address) {
+                            uint64_t addr = instructions[i].address;
+                            bool is_write = isStoreOp(op);
+                            if (model_tlb) translation = dtlb.translate(addr);
+                            if (model_dcache) {
+                                mem = dcache.access(fetch_unit.addressOf(instructions[i]), addr,
+                                                    cycle + translation, is_write);
+                            } else if (model_dram) {
+                                mem.request = dram.enqueue(addr, cycle + translation, is_write, false);
+                            }
+                            stats.memory_stall_cycles += translation + mem.extra;
+                        }
+                        int latency = getInstructionLatency(instructions[i], config);
+                        states[i].exec_latency = translation + mem.extra + latency;
+                        if (config.variable_latency.count(op)) {
+                            int delta = latency - getInstructionLatency(op, config);
+                            if (delta < 0) stats.fast_path_ops++;
+                            if (delta > 0) stats.slow_path_ops++;
+                            stats.data_dependent_cycles += delta;
+                        }
+                        if (mem.request >= 0) {
+                            // Held in EXECUTE until the DRAM data arrives; the
+                            // latency and result time are finalised then.
+                            states[i].mem_request = mem.request;
+                            waiting_on_dram.push_back(i);
+                        }
+
+                        int operand_read = depth[REGREAD];
+                        int ready_at_cycle = (mem.request >= 0) ? INT_MAX
+                                           : cycle + operand_read + states[i].exec_latency;
+                        // A chained consumer may start once the first element
+                        // group is done; scalar results (-1) are not chained.
+                        int chain_ready_at_cycle = (mem.request >= 0) ? INT_MAX
+                                                 : isVectorOp(op) ? ready_at_cycle - config.chainLead(op) : -1;
+                        if (states[i].wrong_path) {
+                            spec_checkpoints[i] = scoreboard.save(instructions[i].dest);
+                            stats.wrong_path_issued++;
+                        }
+                        scoreboard.markBusy(instructions[i].dest, instructions[i].id,
+                                            ready_at_cycle, chain_ready_at_cycle, isFpOp(op));
+
+                        if (isVectorOp(instructions[i].opcode)) {
+                            stats.vector_instructions++;
+                            stats.vector_elements += config.vectorElements();
+                        }
+                        if (model_energy) energy.onIssue(instructions[i], config);
                     
+                    } else if (!dram_queue_ok && exec_units.isAvailable(unit, op, cycle)) {
+                        // STRUCTURAL hazard on the DRAM request queue.
+                        states[i].stalled = true;
+                        states[i].stall_reason = "Structural - DRAM queue full";
+                        #pragma omp atomic
+                        stats.structural_hazards++;
+                        #pragma omp atomic
+                        stats.total_stalls++;
+                    } else if (!read_ports_ok && exec_units.isAvailable(unit, op, cycle)) {
+                        // STRUCTURAL hazard on the register-file read ports.
+                        states[i].operands_read += read_ports_left;
+                        read_ports_left = 0;
+                        states[i].stalled = true;
+                        states[i].stall_reason = "Structural - RF read ports busy";
+                        #pragma omp atomic
+                        stats.rf_read_port_stalls++;
+                        #pragma omp atomic
+                        stats.structural_hazards++;
+                        #pragma omp atomic
+                        stats.total_stalls++;
                     } else {
                         // STRUCTURAL hazard. Stall in ISSUE.
                         states[i].stalled = true;
-                        states[i].stall_reason = "Structural - " + unitToString(unit) + " busy";
+                        states[i].stall_reason = "Structural - " + exec_units.resourceName(unit, op) + " busy";
                         #pragma omp atomic
                         stats.structural_hazards++;
                         #pragma omp atomic
@@ -436,49 +3358,169 @@ int main() {
                 // state and we just stay in ISSUE.
             }
         }
+        exec_units.tick(cycle);
 
-        // -----------------------------------------------------------------
-        // LOGIC FIX: DECODE stage is now just a simple promotion stage.
-        // All hazard logic is in ISSUE.
-        // -----------------------------------------------------------------
+        // Decode stage: a plain promotion stage; all hazard checks are in ISSUE.
         for (int i = 0; i < instructions.size(); i++) {
-            if (states[i].current_stage == DECODE) {
+            // Ops from the decoded-op cache bypass the legacy decoders.
+            int decode_depth = states[i].from_uop_cache ? 1 : depth[DECODE];
+            if (states[i].current_stage == DECODE && ++states[i].cycles_in_stage >= decode_depth) {
                 states[i].current_stage = ISSUE;
+                states[i].cycles_in_stage = 0;
             }
         }
 
-        // --- (Fetch and cycle capture are unchanged) ---
+        // The traced path is fetched only up to the next branch that will
+        // be mispredicted: a conditional branch the direction predictor
+        // gets wrong (with speculation) or a RET whose return-address-stack
+        // prediction is wrong. Unfetched CALL/RETs are replayed on a copy
+        // of the stack to predict each RET as fetch will see it.
+        size_t fetch_limit = num_instructions;
+        int limiting_branch = -1;
+        int limiting_target = 0;   // PC the predicted (wrong) path starts at
+        if (mispredicted_branch >= 0) {
+            fetch_limit = mispredicted_branch + 1;
+        } else if (model_ras) {
+            ReturnAddressStack lookahead = ras;
+            for (size_t i = fetched_upto; i < num_instructions; i++) {
+                const Instruction& instr = instructions[i];
+                if (!instr.is_branch) continue;
+                bool mispredicted = false;
+                if (instr.opcode == CALL) {
+                    lookahead.push(instr.pc + 1);
+                } else if (instr.opcode == RET) {
+                    int predicted = lookahead.pop();
+                    mispredicted = (predicted != instr.target_pc);
+                    limiting_target = max(0, predicted);
+                } else if (model_speculation && !isUnconditionalBranch(instr.opcode) &&
+                           predictor.predict(instr) != instr.taken) {
+                    // Predicted not taken: the fall-through; predicted taken: the target.
+                    mispredicted = true;
+                    limiting_target = instr.taken ? instr.pc + 1 : instr.target_pc;
+                }
+                if (mispredicted) {
+                    fetch_limit = i + 1;
+                    limiting_branch = i;
+                    break;
+                }
+            }
+        }
 
         // Fetch stage (parallel)
-        #pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < instructions.size(); i++) {
+        parallelFor(profile, instructions.size(), [&](int i) {
             if (states[i].current_stage == FETCH) {
-                states[i].current_stage = DECODE;
-                states[i].cycles_in_stage = 0;
-            } else if (states[i].current_stage == IDLE) {
+                if (++states[i].cycles_in_stage >= depth[FETCH]) {
+                    states[i].current_stage = DECODE;
+                    states[i].cycles_in_stage = 0;
+                }
+            } else if (states[i].current_stage == IDLE && !model_front_end && i < (int)fetch_limit) {
                 states[i].current_stage = FETCH;
             }
+        });
+        if (model_front_end) fetch_unit.fetch(cycle, states, fetch_limit);
+
+        // The return-address stack sees the traced path in fetch order.
+        for (; fetched_upto < num_instructions && states[fetched_upto].current_stage != IDLE; fetched_upto++) {
+            if (!model_ras) continue;
+            const Instruction& instr = instructions[fetched_upto];
+            if (instr.opcode == CALL) {
+                ras.push(instr.pc + 1);
+            } else if (instr.opcode == RET && ras.pop() != instr.target_pc) {
+                ras.mispredictions++;
+            }
+        }
+
+        // Wrong-path fetch: copies of the static instructions along the
+        // predicted path enter the pipeline and compete for units and
+        // caches until the branch resolves. It stops at a PC the trace never
+        // reaches. Without speculation fetch just waits.
+        if (mispredicted_branch >= 0 && model_speculation) {
+            for (int n = 0; n < config.front_end.width &&
+                            (int)(instructions.size() - num_instructions) < config.predictor.wrong_path_limit; n++) {
+                auto code = code_at_pc.find(wrong_path_pc);
+                if (code == code_at_pc.end()) break;
+                Instruction copy = instructions[code->second];
+                copy.id = next_wrong_path_id++;
+                copy.original_string += " (wrong path)";
+                PipelineState state;
+                state.current_stage = FETCH;
+                state.wrong_path = true;
+                state.static_index = code->second;
+                if (model_front_end) fetch_unit.touch(copy);
+                stats.wrong_path_fetched++;
+
+                // Wrong-path calls and returns leave the return-address stack alone.
+                bool taken = copy.is_branch && predictor.predict(copy);
+                if (copy.opcode == RET) {
+                    wrong_path_pc = max(0, ras.peek());
+                } else {
+                    wrong_path_pc = taken ? copy.target_pc : copy.pc + 1;
+                }
+                instructions.push_back(copy);
+                states.push_back(state);
+            }
+        }
+        if (limiting_branch >= 0 && states[limiting_branch].current_stage != IDLE) {
+            // The wrong path starts at the predicted target from the next cycle.
+            mispredicted_branch = limiting_branch;
+            wrong_path_pc = limiting_target;
         }
 
         // Update total cycles for active instructions
-        #pragma omp parallel for
-        for (int i = 0; i < instructions.size(); i++) {
+        parallelFor(profile, instructions.size(), [&](int i) {
             if (states[i].current_stage != IDLE &&
                 states[i].current_stage != COMPLETE) {
                 states[i].total_cycles++;
             }
+        });
+        for (size_t k = num_instructions; k < instructions.size(); k++) {
+            if (states[k].current_stage >= REGREAD && states[k].current_stage <= WRITEBACK) {
+                stats.wrong_path_unit_cycles++;
+            }
+        }
+        if (model_energy) {
+            for (size_t i = 0; i < instructions.size(); i++) {
+                if (states[i].current_stage != IDLE && states[i].current_stage != COMPLETE) {
+                    energy.onStageCycle(states[i].current_stage);
+                }
+            }
         }
         
-        cycle_history.push_back(captureCycleState(cycle, instructions, states));
+        // The timeline counts every cycle, also those a query leaves out
+        // of the history.
+        TimelinePyramid::Sample sample;
+        if (config.timeline_pyramid) {
+            sample = pyramid.sample(states);
+            pyramid.addCycle(cycle, sample, exec_units.getCycleBusy()[cycle - 1]);
+        }
+        if (!query) {
+            cycle_history.push_back(captureCycleState(cycle, instructions, states, config));
+            if (memoize) {
+                memo.recordCycle(cycle_history.back(), exec_units.busyAt(cycle),
+                                 config.timeline_pyramid ? &sample : nullptr);
+            }
+            continue;
+        }
+        if (!query->filtering) {
+            cycle_history.push_back(captureCycleState(cycle, instructions, states, config));
+        } else if (query->inWindow(cycle)) {
+            json cycle_data = captureCycleState(cycle, instructions, states, config, query, &exec_units);
+            bool matched = !query->filtersEntries() || !cycle_data["stalls"].empty();
+            for (const auto& [stage, entries] : cycle_data["stages"].items()) matched = matched || !entries.empty();
+            if (matched) cycle_history.push_back(move(cycle_data));
+        }
+        stop_condition = query->untilMet(cycle, instructions, states, num_instructions, exec_units, saturated_run);
+        if (!stop_condition.empty()) break;
 
     } // End main simulation loop
+    double loop_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - loop_start).count();
 
     // Calculate final statistics
     stats.total_cycles = cycle;
     stats.instructions_completed = completed;
     stats.calculate();
 
-    // --- (Final JSON output is unchanged) ---
+    // Final JSON output
     json final_result;
     
     json stats_json;
@@ -490,10 +3532,688 @@ int main() {
     stats_json["warHazards"] = stats.war_hazards;
     stats_json["wawHazards"] = stats.waw_hazords;
     stats_json["structuralHazards"] = stats.structural_hazards;
+    stats_json["rfReadPortStalls"] = stats.rf_read_port_stalls;
+    stats_json["rfWritePortStalls"] = stats.rf_write_port_stalls;
+    stats_json["resultBusStalls"] = stats.result_bus_stalls;
     stats_json["branchMispredictions"] = stats.branch_mispredictions;
+    stats_json["branchPenaltyCycles"] = config.frontEndDepth();
+    stats_json["vectorInstructions"] = stats.vector_instructions;
+    stats_json["vectorElements"] = stats.vector_elements;
     
+    if (exec_units.isPortMode()) {
+        json ports_json = json::array();
+        for (const auto& inst : exec_units.getInstances()) {
+            json port;
+            port["name"] = inst.config.name;
+            port["opsIssued"] = inst.ops_issued;
+            port["busyCycles"] = inst.busy_cycles;
+            port["utilization"] = (stats.total_cycles > 0) ? (double)inst.busy_cycles / stats.total_cycles : 0.0;
+            ports_json.push_back(port);
+        }
+        stats_json["ports"] = ports_json;
+    }
+
+    // Per-instance occupancy and a bucketed utilization timeline; each
+    // timeline row holds one busy fraction per instance, in "instances" order.
+    json utilization_json;
+    json instances_json = json::array();
+    for (const auto& inst : exec_units.getInstances()) {
+        json inst_json;
+        inst_json["name"] = inst.config.name;
+        inst_json["opsExecuted"] = inst.ops_issued;
+        inst_json["busyCycles"] = inst.busy_cycles;
+        inst_json["idleCycles"] = stats.total_cycles - inst.busy_cycles;
+        inst_json["utilization"] = (stats.total_cycles > 0) ? (double)inst.busy_cycles / stats.total_cycles : 0.0;
+        instances_json.push_back(inst_json);
+    }
+    json timeline_json = json::array();
+    const auto& bucket_busy = exec_units.getBucketBusy();
+    int bucket_cycles = exec_units.getBucketCycles();
+    for (size_t b = 0; b < bucket_busy.size(); b++) {
+        int span = min(bucket_cycles, stats.total_cycles - (int)b * bucket_cycles);
+        json row = json::array();
+        for (int busy : bucket_busy[b]) row.push_back(span > 0 ? (double)busy / span : 0.0);
+        timeline_json.push_back(row);
+    }
+    utilization_json["bucketCycles"] = bucket_cycles;
+    utilization_json["instances"] = instances_json;
+    utilization_json["timeline"] = timeline_json;
+
+    if (model_front_end) stats_json["frontEnd"] = fetch_unit.toJson();
+    if (model_tlb) stats_json["tlb"] = dtlb.toJson();
+    if (model_dcache) stats_json["dcache"] = dcache.toJson();
+    if (model_dram) stats_json["dram"] = dram.toJson(stats.total_cycles);
+    if (model_tlb || model_dcache || model_dram) {
+        stats_json["memoryStallCycles"] = stats.memory_stall_cycles;
+    }
+    if (!config.variable_latency.empty()) {
+        json vl_json;
+        vl_json["fastPathOps"] = stats.fast_path_ops;
+        vl_json["slowPathOps"] = stats.slow_path_ops;
+        vl_json["netLatencyCycles"] = stats.data_dependent_cycles;
+        stats_json["variableLatency"] = vl_json;
+    }
+    if (model_energy) {
+        long long cache_fills = model_dcache ? dcache.misses() + dcache.prefetches_issued : 0;
+        long long dram_transfers = model_dram ? dram.row_hits + dram.row_empty + dram.row_conflicts : 0;
+        stats_json["energy"] = energy.toJson(stats.total_cycles, stats.instructions_completed,
+                                             cache_fills, dram_transfers);
+    }
+    if (model_ras && ras.calls + ras.returns > 0) stats_json["returnAddressStack"] = ras.toJson();
+    if (memoize) stats_json["memo"] = memo.toJson();
+    if (profile) stats_json["threadProfile"] = profile->toJson(loop_ms);
+    if (model_speculation) {
+        json spec_json;
+        spec_json["predictor"] = predictorToString(config.predictor.type);
+        spec_json["branches"] = stats.branches_resolved;
+        spec_json["mispredictions"] = stats.branch_mispredictions;
+        spec_json["mispredictionRate"] = stats.branches_resolved > 0
+            ? (double)stats.branch_mispredictions / stats.branches_resolved : 0.0;
+        spec_json["wrongPathFetched"] = stats.wrong_path_fetched;
+        spec_json["wrongPathIssued"] = stats.wrong_path_issued;
+        spec_json["wrongPathSquashed"] = stats.wrong_path_squashed;
+        spec_json["wrongPathUnitCycles"] = stats.wrong_path_unit_cycles;
+        stats_json["speculation"] = spec_json;
+    }
+
+    json stages_json = json::array();
+    for (Stage s : config.activeStages()) stages_json.push_back(stageToString(s));
+
     final_result["stats"] = stats_json;
+    final_result["stages"] = stages_json;
+    final_result["utilization"] = utilization_json;
     final_result["cycles"] = cycle_history;
+    if (config.timeline_pyramid) final_result["timeline"] = pyramid.toJson();
+    if (query) {
+        json query_json;
+        query_json["stopped"] = !stop_condition.empty();
+        if (!stop_condition.empty()) {
+            query_json["stopCycle"] = cycle;
+            query_json["condition"] = stop_condition;
+        }
+        query_json["matchedCycles"] = cycle_history.size();
+        final_result["query"] = query_json;
+    }
+    return final_result;
+}
+
+// Engine k models what the bits of k select: 1 front end, 2 memory,
+// 4 speculation, 8 energy.
+using EngineFn = json (*)(vector<Instruction>, const MachineConfig&, const RunQuery*);
+template <size_t... K>
+constexpr array<EngineFn, sizeof...(K)> makeEngines(index_sequence<K...>) {
+    return {{&simulate<EnginePolicy<(K & 1) != 0, (K & 2) != 0, (K & 4) != 0, (K & 8) != 0>>...}};
+}
+constexpr array<EngineFn, 16> ENGINES = makeEngines(make_index_sequence<16>());
+
+json runSimulation(const vector<Instruction>& instructions, const MachineConfig& config,
+                   const RunQuery* query = nullptr) {
+    bool memory = config.model_tlb || config.model_dcache || config.model_dram;
+    size_t engine = (config.model_front_end ? 1 : 0) | (memory ? 2 : 0) |
+                    (config.model_speculation ? 4 : 0) | (config.model_energy ? 8 : 0);
+    return ENGINES[engine](instructions, config, query);
+}
+
+// --- JIT-compiled sweep kernel ---
+// "mode": "sweep" reruns one program many times with opcode latencies
+// drawn at random. With "jit" (the default) the program and the machine
+// config are written out as C++ constants in front of a compact copy of
+// the core engine's cycle loop, compiled with the system compiler ($CXX,
+// else c++) into a shared object and loaded with dlopen. Operands, unit
+// eligibility and stage depths are then compile-time constants; only
+// the per-instruction latencies vary between runs. The kernel covers the
+// core engine (no front-end, memory, speculation or energy model);
+// other machines, or a failed compile or cross-check, fall back to the
+// interpreted engine.
+static const char* SWEEP_KERNEL_BODY = R"KERNEL(
+#include <vector>
+enum { S_IDLE, S_FETCH, S_DECODE, S_ISSUE, S_REGREAD, S_EXECUTE, S_WRITEBACK, S_COMMIT, S_COMPLETE };
+struct Reg { bool busy; int writer; int ready; int chain; bool fp; };
+
+// Mirrors the core engine of pipeline_fixed.cpp step for step.
+extern "C" void sweep_kernel(const int* latency, const int* chain_latency, long long* out) {
+    std::vector<unsigned char> stage(N, S_IDLE), stalled(N, 0);
+    std::vector<int> cis(N, 0), instance(N, -1), reads_done(N, 0);
+    Reg regs[NUM_REGS];
+    for (auto& r : regs) r = {false, -1, -1, -1, false};
+    bool blocked[NUM_RES + 1] = {};
+    int last_issue[NUM_RES + 1], ops_issued[NUM_RES + 1] = {};
+    for (auto& c : last_issue) c = -1;
+    int rr_next = 0;
+    long long total_stalls = 0, raw_hazards = 0, structural_hazards = 0;
+    int cycle = 0, completed = 0, lo = 0;
+
+    auto find_instance = [&](int i) {
+        int best = -1;
+        for (int k = 0; k < NUM_RES; k++) {
+            int idx = (POLICY == 1) ? (rr_next + k) % NUM_RES : k;
+            if (!((ELIGIBLE[i] >> idx) & 1) || blocked[idx] || last_issue[idx] == cycle) continue;
+            if (POLICY != 2) return idx;
+            if (best < 0 || ops_issued[idx] < ops_issued[best]) best = idx;
+        }
+        return best;
+    };
+    auto busy = [&](int reg, bool chained, int bypass) {
+        if (reg < 0 || reg >= NUM_REGS) return false;
+        if (!regs[reg].busy && bypass == 0) return false;
+        return (chained ? regs[reg].chain : regs[reg].ready) + bypass > cycle;
+    };
+
+    while (completed < N && cycle < MAX_CYCLES) {
+        cycle++;
+        while (lo < N && stage[lo] == S_COMPLETE) lo++;
+
+        bool older_retired = true;
+        for (int i = lo; i < N; i++) {
+            if (stage[i] == S_COMMIT && ++cis[i] >= D_COMMIT && older_retired) {
+                stage[i] = S_COMPLETE;
+                completed++;
+            }
+            if (stage[i] != S_COMPLETE) older_retired = false;
+        }
+        if (RF_WRITE > 0) {
+            int left = RF_WRITE;
+            for (int i = lo; i < N; i++) {
+                if (stage[i] != S_WRITEBACK || DEST[i] < 0 || cis[i] + 1 < D_WRITEBACK) continue;
+                stalled[i] = (left == 0);
+                if (left > 0) left--; else { structural_hazards++; total_stalls++; }
+            }
+        }
+        for (int i = lo; i < N; i++) {
+            if (stage[i] == S_WRITEBACK && !stalled[i] && ++cis[i] >= D_WRITEBACK) {
+                if (DEST[i] >= 0 && regs[DEST[i]].writer == i + 1) regs[DEST[i]].busy = false;
+                if (instance[i] >= 0 && (!PIPELINED[instance[i]] || ITERATIVE[i])) blocked[instance[i]] = false;
+                cis[i] = 0;
+                if (D_COMMIT > 0) {
+                    stage[i] = S_COMMIT;
+                } else {
+                    stage[i] = S_COMPLETE;
+                    completed++;
+                }
+            }
+        }
+        if (BUSES > 0) {
+            int left = BUSES;
+            for (int i = lo; i < N; i++) {
+                if (stage[i] != S_EXECUTE || DEST[i] < 0 || cis[i] + 1 < latency[i]) continue;
+                stalled[i] = (left == 0);
+                if (left > 0) {
+                    left--;
+                } else {
+                    if (regs[DEST[i]].writer == i + 1) { regs[DEST[i]].ready++; regs[DEST[i]].chain++; }
+                    structural_hazards++;
+                    total_stalls++;
+                }
+            }
+        }
+        for (int i = lo; i < N; i++) {
+            if (stage[i] == S_EXECUTE && !stalled[i] && ++cis[i] >= latency[i]) {
+                stage[i] = S_WRITEBACK;
+                cis[i] = 0;
+            }
+        }
+        for (int i = lo; i < N; i++) {
+            if (stage[i] == S_REGREAD && ++cis[i] >= D_REGREAD) {
+                stage[i] = S_EXECUTE;
+                cis[i] = 0;
+            }
+        }
+        int read_ports_left = RF_READ;
+        for (int i = lo; i < N; i++) {
+            if (stage[i] != S_ISSUE || ++cis[i] < D_ISSUE) continue;
+            bool hazard = false;
+            for (int src : {SRC1[i], SRC2[i], SRC3[i]}) {
+                int bypass = (src >= 0 && src < NUM_REGS && regs[src].fp) ? (FP[i] ? FP_BYPASS : FP_CROSS_BYPASS) : 0;
+                if (busy(src, CHAINING && VECTOR[i], bypass)) { hazard = true; break; }
+            }
+            stalled[i] = hazard;
+            if (hazard) { raw_hazards++; total_stalls++; continue; }
+            int idx = NEEDS_UNIT[i] ? find_instance(i) : -1;
+            bool available = !NEEDS_UNIT[i] || idx >= 0;
+            int reads_needed = READS[i] - reads_done[i];
+            bool read_ports_ok = RF_READ == 0 || reads_needed <= read_ports_left;
+            if (available && read_ports_ok) {
+                read_ports_left -= reads_needed;
+                if (idx >= 0) {
+                    last_issue[idx] = cycle;
+                    blocked[idx] = !PIPELINED[idx] || ITERATIVE[i];
+                    ops_issued[idx]++;
+                    rr_next = (idx + 1) % NUM_RES;
+                }
+                instance[i] = idx;
+                stage[i] = D_REGREAD > 0 ? S_REGREAD : S_EXECUTE;
+                cis[i] = 0;
+                if (DEST[i] >= 0 && DEST[i] < NUM_REGS) {
+                    regs[DEST[i]] = {true, i + 1, cycle + D_REGREAD + latency[i],
+                                     cycle + D_REGREAD + chain_latency[i], FP[i]};
+                }
+            } else {
+                if (available) {
+                    reads_done[i] += read_ports_left;
+                    read_ports_left = 0;
+                }
+                stalled[i] = true;
+                structural_hazards++;
+                total_stalls++;
+            }
+        }
+        for (int i = lo; i < N; i++) {
+            if (stage[i] == S_DECODE && ++cis[i] >= D_DECODE) {
+                stage[i] = S_ISSUE;
+                cis[i] = 0;
+            }
+        }
+        for (int i = lo; i < N; i++) {
+            if (stage[i] == S_FETCH) {
+                if (++cis[i] >= D_FETCH) {
+                    stage[i] = S_DECODE;
+                    cis[i] = 0;
+                }
+            } else if (stage[i] == S_IDLE) {
+                stage[i] = S_FETCH;
+            }
+        }
+    }
+    out[0] = cycle;
+    out[1] = completed;
+    out[2] = total_stalls;
+    out[3] = raw_hazards;
+    out[4] = structural_hazards;
+}
+)KERNEL";
+
+typedef void (*SweepKernelFn)(const int*, const int*, long long*);
+
+// A compiled kernel for one program and machine. load() returns false
+// and sets `error` when the machine is outside the kernel's scope or the
+// toolchain is unavailable.
+class SweepKernel {
+private:
+    void* handle;
+    string directory;
+
+    template <class T>
+    static void emitArray(ostringstream& src, const char* type, const char* name, const vector<T>& values) {
+        src << "constexpr " << type << ' ' << name << "[] = {";
+        for (size_t i = 0; i < values.size(); i++) src << (i ? "," : "") << +values[i];
+        if (values.empty()) src << 0;
+        src << "};\n";
+    }
+public:
+    SweepKernelFn run;
+    string error;
+    double compile_ms;
+
+    SweepKernel() : handle(nullptr), run(nullptr), compile_ms(0) {}
+    ~SweepKernel() {
+        if (handle) dlclose(handle);
+        if (!directory.empty()) {
+            remove((directory + "/kernel.cpp").c_str());
+            remove((directory + "/kernel.so").c_str());
+            remove((directory + "/compile.log").c_str());
+            rmdir(directory.c_str());
+        }
+    }
+
+    static string source(const vector<Instruction>& instrs, const MachineConfig& config) {
+        ExecutionUnits units(config);
+        const auto& resources = units.getInstances();
+        ostringstream src;
+        src << "constexpr int N = " << instrs.size() << ";\n"
+            << "constexpr int NUM_REGS = " << NUM_SCALAR_REGS + NUM_VECTOR_REGS << ";\n"
+            << "constexpr int NUM_RES = " << resources.size() << ";\n"
+            << "constexpr int POLICY = " << (int)config.port_policy << ";\n"
+            << "constexpr int MAX_CYCLES = " << config.max_cycles << ";\n"
+            << "constexpr int RF_READ = " << config.rf_read_ports << ";\n"
+            << "constexpr int RF_WRITE = " << config.rf_write_ports << ";\n"
+            << "constexpr int BUSES = " << config.result_buses << ";\n"
+            << "constexpr int FP_BYPASS = " << config.fp_bypass_latency << ";\n"
+            << "constexpr int FP_CROSS_BYPASS = " << config.fp_cross_bypass_latency << ";\n"
+            << "constexpr bool CHAINING = " << config.vector_chaining << ";\n";
+        for (Stage s : {FETCH, DECODE, ISSUE, REGREAD, WRITEBACK, COMMIT}) {
+            src << "constexpr int D_" << stageToString(s) << " = " << config.stageDepth(s) << ";\n";
+        }
+        vector<int> pipelined;
+        for (const auto& inst : resources) pipelined.push_back(inst.config.pipelined);
+        emitArray(src, "bool", "PIPELINED", pipelined);
+        vector<int> src1, src2, src3, dest, reads, fp, vector_op, iterative, needs_unit;
+        vector<unsigned long long> eligible;
+        for (const auto& instr : instrs) {
+            src1.push_back(instr.src1);
+            src2.push_back(instr.src2);
+            src3.push_back(instr.src3);
+            dest.push_back(instr.dest);
+            reads.push_back(instr.registerReads());
+            fp.push_back(isFpOp(instr.opcode));
+            vector_op.push_back(isVectorOp(instr.opcode));
+            iterative.push_back(isIterativeOp(instr.opcode));
+            needs_unit.push_back(getExecUnit(instr.opcode) != ANY_UNIT);
+            unsigned long long mask = 0;
+            for (size_t k = 0; k < resources.size(); k++) {
+                if (resources[k].config.supports(instr.opcode)) mask |= 1ULL << k;
+            }
+            eligible.push_back(mask);
+        }
+        emitArray(src, "int", "SRC1", src1);
+        emitArray(src, "int", "SRC2", src2);
+        emitArray(src, "int", "SRC3", src3);
+        emitArray(src, "int", "DEST", dest);
+        emitArray(src, "int", "READS", reads);
+        emitArray(src, "bool", "FP", fp);
+        emitArray(src, "bool", "VECTOR", vector_op);
+        emitArray(src, "bool", "ITERATIVE", iterative);
+        emitArray(src, "bool", "NEEDS_UNIT", needs_unit);
+        emitArray(src, "unsigned long long", "ELIGIBLE", eligible);
+        src << SWEEP_KERNEL_BODY;
+        return src.str();
+    }
+
+    bool load(const vector<Instruction>& instrs, const MachineConfig& config) {
+        if (config.model_front_end || config.model_tlb || config.model_dcache || config.model_dram ||
+            config.model_speculation || config.model_energy) {
+            error = "The kernel covers the core engine only (no frontEnd, tlb, dcache, dram, branchPredictor or energy).";
+            return false;
+        }
+        if (ExecutionUnits(config).getInstances().size() > 64) {
+            error = "The kernel supports at most 64 execution resources.";
+            return false;
+        }
+        auto start = chrono::steady_clock::now();
+        char dir_template[] = "/tmp/pipeline-jit-XXXXXX";
+        if (!mkdtemp(dir_template)) {
+            error = "Could not create a build directory.";
+            return false;
+        }
+        directory = dir_template;
+        ofstream(directory + "/kernel.cpp") << source(instrs, config);
+        const char* cxx = getenv("CXX");
+        string command = string(cxx && *cxx ? cxx : "c++") + " -std=c++17 -O2 -shared -fPIC -o " +
+                         directory + "/kernel.so " + directory + "/kernel.cpp > " +
+                         directory + "/compile.log 2>&1";
+        if (system(command.c_str()) != 0) {
+            error = "Compiling the kernel failed.";
+            return false;
+        }
+        handle = dlopen((directory + "/kernel.so").c_str(), RTLD_NOW | RTLD_LOCAL);
+        if (handle) run = (SweepKernelFn)dlsym(handle, "sweep_kernel");
+        if (!run) {
+            error = "Loading the kernel failed.";
+            return false;
+        }
+        compile_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        return true;
+    }
+};
+
+// Runs the latency sweep described by `spec`. Throws json::exception on
+// a malformed spec.
+json runSweep(const json& spec, const vector<Instruction>& instructions, const MachineConfig& config) {
+    long long runs = max(1LL, spec.value("runs", 100LL));
+    unsigned seed = spec.value("seed", 1u);
+    bool use_jit = spec.value("jit", true);
+    // "latencies": {"LOAD": [min, max], "MUL": 4}: each run draws every
+    // listed opcode's latency uniformly from its range.
+    vector<pair<Opcode, pair<int, int>>> ranges;
+    if (spec.contains("latencies")) {
+        for (auto& [name, range] : spec["latencies"].items()) {
+            Opcode op = stringToOpcode(name);
+            if (op == NOP && name != "NOP") continue;
+            int lo = range.is_array() ? range.at(0).get<int>() : range.get<int>();
+            int hi = range.is_array() ? range.at(1).get<int>() : lo;
+            lo = max(1, lo);
+            ranges.push_back({op, {lo, max(lo, hi)}});
+        }
+    }
+
+    SweepKernel kernel;
+    bool jit = use_jit && kernel.load(instructions, config);
+    mt19937 rng(seed);
+    const size_t n = instructions.size();
+    // A run's kernel inputs: each op's drawn latency and, as in
+    // simulate(), the latency at which its first element group reaches
+    // chained consumers.
+    auto kernelLatencies = [&](const MachineConfig& run_config, vector<int>& latency,
+                               vector<int>& chain_latency) {
+        for (size_t i = 0; i < n; i++) {
+            latency[i] = getInstructionLatency(instructions[i], run_config);
+            chain_latency[i] = latency[i] - run_config.chainLead(instructions[i].opcode);
+        }
+    };
+
+    // Latencies are drawn in run order, the runs of a batch are spread
+    // over the team (each run's own loops then stay on its thread) and
+    // their results are folded in in run order, so the output does not
+    // depend on the thread count.
+    const long long BATCH = 1024;
+    const size_t MAX_SAMPLES = 1000;
+    vector<int> draws(BATCH * ranges.size());
+    vector<long long> batch_cycles(BATCH), batch_completed(BATCH);
+    // With an energy model every run is interpreted (the kernel has none)
+    // and also reports its total energy and energy-delay product.
+    const bool energy = config.model_energy;
+    vector<double> batch_energy(energy ? BATCH : 0), batch_edp(energy ? BATCH : 0);
+    auto runConfig = [&](long long r) {
+        MachineConfig run_config = config;
+        for (size_t k = 0; k < ranges.size(); k++) {
+            run_config.op_latency[ranges[k].first] = draws[r * ranges.size() + k];
+        }
+        return run_config;
+    };
+    json samples = json::array();
+    long long min_cycles = LLONG_MAX, max_cycles = 0;
+    double sum = 0, sum_sq = 0, ipc_sum = 0;
+    double min_energy = DBL_MAX, max_energy = 0, energy_sum = 0, energy_sum_sq = 0;
+    double min_edp = DBL_MAX, max_edp = 0, edp_sum = 0, edp_sum_sq = 0;
+    bool verified = false;
+    double verify_ms = 0;
+    omp_set_max_active_levels(1);
+    auto start = chrono::steady_clock::now();
+    for (long long base = 0; base < runs; base += BATCH) {
+        long long count = min(BATCH, runs - base);
+        for (long long r = 0; r < count; r++) {
+            for (size_t k = 0; k < ranges.size(); k++) {
+                const auto& range = ranges[k].second;
+                draws[r * ranges.size() + k] = uniform_int_distribution<int>(range.first, range.second)(rng);
+            }
+        }
+        long long first = 0;
+        if (base == 0 && jit) {
+            // Cross-check the kernel against the interpreted engine once.
+            MachineConfig run_config = runConfig(0);
+            vector<int> latency(n), chain_latency(n);
+            kernelLatencies(run_config, latency, chain_latency);
+            long long out[5];
+            kernel.run(latency.data(), chain_latency.data(), out);
+            auto verify_start = chrono::steady_clock::now();
+            json reference = runSimulation(instructions, run_config)["stats"];
+            verify_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - verify_start).count();
+            verified = reference["totalCycles"] == out[0] && reference["instructionsCompleted"] == out[1] &&
+                       reference["totalStalls"] == out[2] && reference["rawHazards"] == out[3] &&
+                       reference["structuralHazards"] == out[4];
+            batch_cycles[0] = out[0];
+            batch_completed[0] = out[1];
+            if (!verified) {
+                jit = false;
+                kernel.error = "The kernel disagreed with the interpreted engine.";
+                batch_cycles[0] = reference["totalCycles"];
+                batch_completed[0] = reference["instructionsCompleted"];
+            }
+            first = 1;
+        }
+        #pragma omp parallel for schedule(dynamic)
+        for (long long r = first; r < count; r++) {
+            MachineConfig run_config = runConfig(r);
+            if (jit) {
+                vector<int> latency(n), chain_latency(n);
+                kernelLatencies(run_config, latency, chain_latency);
+                long long out[5];
+                kernel.run(latency.data(), chain_latency.data(), out);
+                batch_cycles[r] = out[0];
+                batch_completed[r] = out[1];
+            } else {
+                json stats = runSimulation(instructions, run_config)["stats"];
+                batch_cycles[r] = stats["totalCycles"];
+                batch_completed[r] = stats["instructionsCompleted"];
+                if (energy) {
+                    batch_energy[r] = stats["energy"]["totalEnergyPj"];
+                    batch_edp[r] = stats["energy"]["energyDelayProductPjNs"];
+                }
+            }
+        }
+        for (long long r = 0; r < count; r++) {
+            long long cycles = batch_cycles[r], completed = batch_completed[r];
+            min_cycles = min(min_cycles, cycles);
+            max_cycles = max(max_cycles, cycles);
+            sum += cycles;
+            sum_sq += (double)cycles * cycles;
+            ipc_sum += cycles > 0 ? (double)completed / cycles : 0.0;
+            if ((size_t)(base + r) < MAX_SAMPLES) samples.push_back(cycles);
+            if (energy) {
+                min_energy = min(min_energy, batch_energy[r]);
+                max_energy = max(max_energy, batch_energy[r]);
+                energy_sum += batch_energy[r];
+                energy_sum_sq += batch_energy[r] * batch_energy[r];
+                min_edp = min(min_edp, batch_edp[r]);
+                max_edp = max(max_edp, batch_edp[r]);
+                edp_sum += batch_edp[r];
+                edp_sum_sq += batch_edp[r] * batch_edp[r];
+            }
+        }
+    }
+    double run_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() - verify_ms;
+
+    json j;
+    j["runs"] = runs;
+    j["engine"] = jit ? "jit" : "interpreted";
+    if (use_jit && !jit) j["jitUnavailable"] = kernel.error;
+    if (jit) {
+        j["compileMs"] = kernel.compile_ms;
+        j["verified"] = verified;
+        j["verifyMs"] = verify_ms;
+    }
+    j["threads"] = omp_get_max_threads();
+    j["runMs"] = run_ms;
+    j["msPerRun"] = run_ms / runs;
+    double mean = sum / runs;
+    j["totalCycles"] = {{"min", min_cycles}, {"max", max_cycles}, {"mean", mean},
+                        {"stddev", sqrt(max(0.0, sum_sq / runs - mean * mean))}};
+    j["meanIpc"] = ipc_sum / runs;
+    if (energy) {
+        double energy_mean = energy_sum / runs, edp_mean = edp_sum / runs;
+        j["totalEnergyPj"] = {{"min", min_energy}, {"max", max_energy}, {"mean", energy_mean},
+                              {"stddev", sqrt(max(0.0, energy_sum_sq / runs - energy_mean * energy_mean))}};
+        j["energyDelayProductPjNs"] = {{"min", min_edp}, {"max", max_edp}, {"mean", edp_mean},
+                                       {"stddev", sqrt(max(0.0, edp_sum_sq / runs - edp_mean * edp_mean))}};
+    }
+    j["samples"] = samples; // totalCycles of the first runs
+    return j;
+}
+
+int main() {
+    json input_json;
+    try {
+        cin >> input_json;
+    } catch (json::parse_error& e) {
+        json error_json;
+        error_json["error"] = "Invalid JSON input.";
+        error_json["details"] = e.what();
+        cout << error_json.dump() << endl;
+        return 1;
+    }
+
+    vector<string> instruction_strings = input_json["instructions"].get<vector<string>>();
+    vector<Instruction> instructions = loadInstructionsFromString(instruction_strings);
+
+    MachineConfig config;
+    try {
+        if (input_json.contains("config")) config = parseMachineConfig(input_json["config"]);
+    } catch (exception& e) {
+        json error_json;
+        error_json["error"] = "Invalid machine configuration.";
+        error_json["details"] = e.what();
+        cout << error_json.dump() << endl;
+        return 1;
+    }
+
+    // Team size: config "threads", else $PIPELINE_THREADS, else 4.
+    // bench/threads.js measures which count suits the host.
+    int threads = config.threads;
+    if (threads == 0 && getenv("PIPELINE_THREADS")) threads = atoi(getenv("PIPELINE_THREADS"));
+    omp_set_num_threads(threads > 0 ? threads : 4);
+
+    if (instructions.empty()) {
+        json error_json;
+        error_json["error"] = "No instructions loaded from input.";
+        cout << error_json.dump() << endl;
+        return 1;
+    }
+
+    // "query": run-until conditions and output filters.
+    unique_ptr<RunQuery> query;
+    try {
+        if (input_json.contains("query")) query = make_unique<RunQuery>(parseRunQuery(input_json["query"]));
+    } catch (exception& e) {
+        json error_json;
+        error_json["error"] = "Invalid query.";
+        error_json["details"] = e.what();
+        cout << error_json.dump() << endl;
+        return 1;
+    }
+
+    // In port mode an opcode no port accepts would stall forever.
+    ExecutionUnits exec_units(config);
+    for (const auto& instr : instructions) {
+        if (!exec_units.hasResourceFor(instr.opcode)) {
+            json error_json;
+            error_json["error"] = "No execution unit or port accepts " + opcodeToString(instr.opcode) + ".";
+            cout << error_json.dump() << endl;
+            return 1;
+        }
+    }
+    // "mode": "interval" answers from the analytical model alone;
+    // "compare" runs the cycle loop too and reports the model's error.
+    string mode = input_json.value("mode", string("cycle"));
+    json interval_json;
+    double interval_ms = 0;
+    if (mode == "interval" || mode == "compare") {
+        auto start = chrono::steady_clock::now();
+        interval_json = estimateInterval(instructions, config);
+        interval_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+        interval_json["runtimeMs"] = interval_ms;
+        if (mode == "interval") {
+            json output;
+            output["result"]["interval"] = interval_json;
+            cout << output.dump(2) << endl;
+            return 0;
+        }
+    }
+    if (mode == "sweep") {
+        json output;
+        try {
+            output["result"]["sweep"] = runSweep(input_json.value("sweep", json::object()), instructions, config);
+        } catch (json::exception& e) {
+            json error_json;
+            error_json["error"] = "Invalid sweep specification.";
+            error_json["details"] = e.what();
+            cout << error_json.dump() << endl;
+            return 1;
+        }
+        cout << output.dump(2) << endl;
+        return 0;
+    }
+    auto simulation_start = chrono::steady_clock::now();
+    json final_result = runSimulation(instructions, config, query.get());
+
+    if (mode == "compare") {
+        double simulation_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - simulation_start).count();
+        long long estimate = interval_json["totalCycles"].get<long long>();
+        int simulated = final_result["stats"]["totalCycles"].get<int>();
+        interval_json["simulatedCycles"] = simulated;
+        interval_json["errorPercent"] = simulated > 0 ? 100.0 * (estimate - simulated) / simulated : 0.0;
+        interval_json["simulationRuntimeMs"] = simulation_ms;
+        interval_json["speedup"] = interval_ms > 0 ? simulation_ms / interval_ms : 0.0;
+        final_result["interval"] = interval_json;
+    }
 
     json output;
     output["result"] = final_result;
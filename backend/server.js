@@ -5,6 +5,7 @@ const multer = require('multer');
 const fs = require('fs');
 const os = require('os');
 const path = require('path');
+const crypto = require('crypto');
 
 const app = express();
 const port = 3001;
@@ -15,6 +16,51 @@ const upload = multer({ dest: os.tmpdir() });
 app.use(cors()); // Allow requests from your React
 app.use(express.json()); // Parse JSON bodies
 
+// Level-of-detail timelines of recent runs, served by /api/timeline.
+// Only the newest MAX_TIMELINES are kept (Map iterates oldest first).
+const timelines = new Map();
+const MAX_TIMELINES = 20;
+const MAX_TIMELINE_BUCKETS = 4096;
+
+// Limits on the client's machine config. Only the sections below are
+// forwarded; the simulator bounds every size and count inside them and
+// rejects a config that exceeds one. The level-of-detail timeline is
+// only built for runs allowed to outlast what the per-cycle view
+// comfortably shows, unless the client asks for it ("timelinePyramid").
+const CONFIG_KEYS = new Set([
+  'units', 'vector', 'latencies', 'variableLatency', 'fp', 'ports', 'portPolicy', 'pipeline',
+  'registerFile', 'resultBuses', 'frontEnd', 'tlb', 'dcache', 'dram', 'branchPredictor', 'energy',
+  'maxCycles', 'memoizeBlocks', 'threads', 'profileThreads', 'timelinePyramid', 'utilizationBucketCycles',
+]);
+const DEFAULT_MAX_CYCLES = 500; // The simulator's own default
+const MAX_SIM_CYCLES = 1000000;
+const PYRAMID_MIN_CYCLES = 5000;
+
+// Returns the config to pass to the simulator, or an error string.
+function simulationConfig(config) {
+  if (config === undefined) config = {};
+  if (config === null || typeof config !== 'object' || Array.isArray(config)) {
+    return { error: 'config must be an object.' };
+  }
+  const unknown = Object.keys(config).filter(key => !CONFIG_KEYS.has(key));
+  if (unknown.length > 0) {
+    return { error: `Unknown config field(s): ${unknown.join(', ')}.` };
+  }
+  const maxCycles = config.maxCycles === undefined ? DEFAULT_MAX_CYCLES : config.maxCycles;
+  if (!Number.isInteger(maxCycles) || maxCycles < 1 || maxCycles > MAX_SIM_CYCLES) {
+    return { error: `config.maxCycles must be an integer from 1 to ${MAX_SIM_CYCLES}.` };
+  }
+  if (config.threads !== undefined &&
+      (!Number.isInteger(config.threads) || config.threads < 0 || config.threads > os.cpus().length)) {
+    return { error: `config.threads must be an integer from 0 to ${os.cpus().length}.` };
+  }
+  if (config.timelinePyramid !== undefined && typeof config.timelinePyramid !== 'boolean') {
+    return { error: 'config.timelinePyramid must be a boolean.' };
+  }
+  const timelinePyramid = config.timelinePyramid ?? maxCycles >= PYRAMID_MIN_CYCLES;
+  return { config: { ...config, maxCycles, timelinePyramid } };
+}
+
 // --- Endpoint to Generate Instructions ---
 app.post('/api/generate-instructions', (req, res) => {
   const { count = 10 } = req.body;
@@ -67,12 +113,20 @@ app.post('/api/upload-file', upload.single('file'), (req, res) => {
 
 
 // --- Endpoint to Run Simulation ---
+// An optional machine `config` is passed to the simulator after the
+// checks in simulationConfig(). An optional `query` ({ until, filter })
+// is evaluated by the simulator, which then returns only the cycles it
+// matches.
 app.post('/api/simulate', (req, res) => {
-  const { instructions } = req.body;
+  const { instructions, query } = req.body;
 
   if (!instructions || instructions.length === 0) {
     return res.status(400).json({ error: 'No instructions provided.' });
   }
+  const { config, error } = simulationConfig(req.body.config);
+  if (error) {
+    return res.status(400).json({ error });
+  }
 
   console.log(`[LOG] Spawning C++ simulation with ${instructions.length} instructions...`);
 
@@ -101,6 +155,16 @@ app.post('/api/simulate', (req, res) => {
     console.log(`[LOG] C++ process exited with code ${code}`);
     
     if (code !== 0) {
+      // A config or query the simulator rejects is the client's error.
+      let rejection = null;
+      try {
+        rejection = JSON.parse(stdoutData);
+      } catch (err) {
+        // Not a structured error
+      }
+      if (rejection && rejection.error) {
+        return res.status(400).json({ error: rejection.error, details: rejection.details });
+      }
       return res.status(500).json({ 
         error: 'Simulation failed.', 
         stderr: stderrData 
@@ -110,6 +174,14 @@ app.post('/api/simulate', (req, res) => {
     try {
       // The C++ app's entire output is the JSON string
       const simulationResult = JSON.parse(stdoutData);
+      const { timeline } = simulationResult.result;
+      if (timeline) {
+        const timelineId = crypto.randomUUID();
+        timelines.set(timelineId, timeline);
+        if (timelines.size > MAX_TIMELINES) timelines.delete(timelines.keys().next().value);
+        delete simulationResult.result.timeline;
+        simulationResult.result.timelineId = timelineId;
+      }
       console.log('[LOG] Simulation successful. Sending JSON to client.');
       res.json(simulationResult); // This will be { "result": { ... } }
     
@@ -124,11 +196,43 @@ app.post('/api/simulate', (req, res) => {
   });
 
   // Write the instructions (as JSON) to the C++ process's stdin
-  const payload = JSON.stringify({ instructions });
+  const payload = JSON.stringify({ instructions, config, query });
   simProcess.stdin.write(payload);
   simProcess.stdin.end();
 });
 
+// --- Endpoint to Read a Timeline ---
+// GET /api/timeline/:id?from=1&to=5000&maxBuckets=200 returns the buckets
+// covering cycles [from, to] from the finest level that needs at most
+// maxBuckets of them, so any zoom costs a bounded response.
+app.get('/api/timeline/:id', (req, res) => {
+  const timeline = timelines.get(req.params.id);
+  if (!timeline) {
+    return res.status(404).json({ error: 'Unknown or expired timeline.' });
+  }
+
+  const lastCycle = timeline.levels[0].buckets.length;
+  const from = Math.max(1, parseInt(req.query.from, 10) || 1);
+  const to = Math.max(from, Math.min(lastCycle, parseInt(req.query.to, 10) || lastCycle));
+  const maxBuckets = Math.min(MAX_TIMELINE_BUCKETS, Math.max(1, parseInt(req.query.maxBuckets, 10) || 200));
+
+  const level = timeline.levels.find(l => Math.ceil((to - from + 1) / l.cyclesPerBucket) <= maxBuckets)
+    || timeline.levels[timeline.levels.length - 1];
+  const first = Math.floor((from - 1) / level.cyclesPerBucket);
+  const last = Math.floor((to - 1) / level.cyclesPerBucket);
+
+  res.json({
+    stages: timeline.stages,
+    units: timeline.units,
+    stallReasons: timeline.stallReasons,
+    cyclesPerBucket: level.cyclesPerBucket,
+    from,
+    to,
+    totalCycles: lastCycle,
+    buckets: level.buckets.slice(first, last + 1),
+  });
+});
+
 app.listen(port, () => {
   console.log(`CPU Pipeline API Server listening at http://localhost:${port}`);
 });
@@ -1,14 +1,51 @@
 'use client';
-import React, { useState, useEffect, useRef } from 'react';
+import React, { useState, useEffect, useRef, useCallback } from 'react';
 import { 
   Play, Pause, SkipForward, RotateCcw, Plus, Zap, 
-  AlertCircle, Upload, FileText, X, Loader2 
+  AlertCircle, Upload, FileText, X, Loader2,
+  ZoomIn, ZoomOut, Maximize2
 } from 'lucide-react';
 
+// Runs simulationWorker.js for the component's lifetime. Returns
+// request(type, payload, transfer), a promise of the worker's reply.
+function useResultWorker() {
+  const workerRef = useRef(null);
+  const pendingRef = useRef(new Map());
+  const nextIdRef = useRef(0);
+
+  useEffect(() => {
+    const worker = new Worker(new URL('./simulationWorker.js', import.meta.url));
+    const pending = pendingRef.current;
+    worker.onmessage = ({ data }) => {
+      const request = pending.get(data.id);
+      if (!request) return;
+      pending.delete(data.id);
+      if (data.error) request.reject(new Error(data.error));
+      else request.resolve(data.result);
+    };
+    workerRef.current = worker;
+    return () => {
+      worker.terminate();
+      workerRef.current = null;
+      pending.clear();
+    };
+  }, []);
+
+  return useCallback((type, payload = {}, transfer = []) => new Promise((resolve, reject) => {
+    if (!workerRef.current) return reject(new Error('Result worker is not running'));
+    const id = nextIdRef.current++;
+    pendingRef.current.set(id, { resolve, reject });
+    workerRef.current.postMessage({ id, type, ...payload }, transfer);
+  }), []);
+}
+
 // Main Component
 export default function PipelineVisualizer() {
   const [instructions, setInstructions] = useState([]);
+  // Run summary without the cycle history, which stays in the worker
   const [simulationData, setSimulationData] = useState(null);
+  const [resultIndex, setResultIndex] = useState(null); // Typed arrays built by the worker
+  const [cycleData, setCycleData] = useState(null);
   const [currentCycle, setCurrentCycle] = useState(0);
   const [isPlaying, setIsPlaying] = useState(false);
   const [loading, setLoading] = useState(null); // 'generate', 'upload', 'simulate'
@@ -17,11 +54,14 @@ export default function PipelineVisualizer() {
   const [uploadedFile, setUploadedFile] = useState(null);
   const fileInputRef = useRef(null);
   
+  const requestWorker = useResultWorker();
+  
   const API_URL = process.env.NEXT_PUBLIC_API_URL || 'http://localhost:3001';
 
   const clearAll = () => {
     setInstructions([]);
     setSimulationData(null);
+    setResultIndex(null);
     setCurrentCycle(0);
     setIsPlaying(false);
     setError(null);
@@ -101,12 +141,17 @@ export default function PipelineVisualizer() {
         throw new Error(`HTTP ${response.status}: ${errorData.error || response.statusText}`);
       }
       
-      const data = await response.json();
-      if (!data.result || !data.result.cycles) {
-        throw new Error('Invalid simulation data received');
-      }
+      // Decoding and indexing happen in the worker; the body is handed
+      // over without a copy.
+      const buffer = await response.arrayBuffer();
+      const { summary, index, series } = await requestWorker('load', {
+        buffer,
+        contentType: response.headers.get('Content-Type'),
+        instructions
+      }, [buffer]);
       
-      setSimulationData(data.result);
+      setSimulationData(summary);
+      setResultIndex({ ...index, series });
       setCurrentCycle(0);
       setIsPlaying(false);
     } catch (err) {
@@ -115,9 +160,21 @@ export default function PipelineVisualizer() {
     setLoading(null);
   };
 
+  useEffect(() => {
+    if (!simulationData) {
+      setCycleData(null);
+      return;
+    }
+    let cancelled = false;
+    requestWorker('cycle', { index: currentCycle })
+      .then(data => { if (!cancelled) setCycleData(data); })
+      .catch(err => { if (!cancelled) setError('Simulation error: ' + err.message); });
+    return () => { cancelled = true; };
+  }, [simulationData, currentCycle, requestWorker]);
+
   useEffect(() => {
     let interval;
-    if (isPlaying && simulationData && currentCycle < simulationData.cycles.length - 1) {
+    if (isPlaying && simulationData && currentCycle < simulationData.cycleCount - 1) {
       interval = setInterval(() => {
         setCurrentCycle(prev => prev + 1);
       }, 800);
@@ -127,8 +184,6 @@ export default function PipelineVisualizer() {
     return () => clearInterval(interval);
   }, [isPlaying, currentCycle, simulationData]);
 
-  const cycleData = simulationData?.cycles[currentCycle];
-
   const isLoading = (action) => loading === action;
 
   return (
@@ -169,6 +224,8 @@ export default function PipelineVisualizer() {
               isLoading={isLoading}
               fileInputRef={fileInputRef}
               instructions={instructions}
+              resultIndex={resultIndex}
+              setCurrentCycle={setCurrentCycle}
               uploadedFile={uploadedFile}
               clearAll={clearAll}
             />
@@ -181,6 +238,8 @@ export default function PipelineVisualizer() {
                   currentCycle={currentCycle}
                   setCurrentCycle={setCurrentCycle}
                   simulationData={simulationData}
+                  cycleData={cycleData}
+                  series={resultIndex?.series}
                 />
                 <StatsSummary simulationData={simulationData} />
               </>
@@ -191,7 +250,16 @@ export default function PipelineVisualizer() {
           <main className="md:col-span-8 lg:col-span-9">
             {simulationData ? (
               <div className="space-y-6">
-                <PipelineStagesDisplay cycleData={cycleData} />
+                {simulationData.timelineId && (
+                  <TimelineOverview
+                    apiUrl={API_URL}
+                    timelineId={simulationData.timelineId}
+                    totalCycles={simulationData.cycleCount}
+                    currentCycle={currentCycle}
+                    setCurrentCycle={setCurrentCycle}
+                  />
+                )}
+                <PipelineStagesDisplay cycleData={cycleData} stages={simulationData.stages} />
                 {cycleData?.stalls?.length > 0 && (
                   <StallsDisplay stalls={cycleData.stalls} />
                 )}
@@ -209,8 +277,23 @@ export default function PipelineVisualizer() {
 
 // --- Sub-Components ---
 
+const DEFAULT_STAGES = ['FETCH', 'DECODE', 'ISSUE', 'EXECUTE', 'WRITEBACK'];
+
+const STAGE_COLORS = {
+  FETCH: 'bg-blue-500',
+  DECODE: 'bg-purple-500',
+  ISSUE: 'bg-yellow-500',
+  REGREAD: 'bg-teal-500',
+  EXECUTE: 'bg-green-500',
+  WRITEBACK: 'bg-red-500',
+  COMMIT: 'bg-pink-500'
+};
+
+// Upper bound on the bars the timeline fetches, whatever the zoom
+const TIMELINE_BUCKETS = 120;
+
 // Panel for Generate/Upload/Simulate
-function ControlPanel({ instructionCount, setInstructionCount, generateInstructions, handleFileUpload, runSimulation, loading, isLoading, fileInputRef, instructions, uploadedFile, clearAll }) {
+function ControlPanel({ instructionCount, setInstructionCount, generateInstructions, handleFileUpload, runSimulation, loading, isLoading, fileInputRef, instructions, resultIndex, setCurrentCycle, uploadedFile, clearAll }) {
   return (
     <div className="bg-gray-800/50 backdrop-blur-sm rounded-xl p-6 border border-gray-700">
       <div className="flex justify-between items-center mb-4">
@@ -286,9 +369,24 @@ function ControlPanel({ instructionCount, setInstructionCount, generateInstructi
           <div className="mt-4 p-3 bg-gray-900/50 rounded-lg">
             <p className="text-sm text-gray-400 mb-2">Loaded Instructions ({instructions.length}):</p>
             <div className="text-xs font-mono text-gray-300 max-h-32 overflow-y-auto space-y-1 pr-2">
-              {instructions.map((instr, i) => (
-                <div key={i}>{instr}</div>
-              ))}
+              {instructions.map((instr, i) => {
+                // Cycles the instruction was in flight, from the worker's index
+                const row = resultIndex && i < resultIndex.lineRow.length ? resultIndex.lineRow[i] : -1;
+                if (row < 0) return <div key={i}>{instr}</div>;
+                const first = resultIndex.firstCycle[row];
+                const last = resultIndex.lastCycle[row];
+                return (
+                  <div
+                    key={i}
+                    onClick={() => setCurrentCycle(first)}
+                    className="flex justify-between gap-2 cursor-pointer hover:text-white"
+                    title={`${resultIndex.stalledCycles[row]} stalled cycle(s)`}
+                  >
+                    <span>{instr}</span>
+                    <span className="text-gray-500">c{first + 1}-{last + 1}</span>
+                  </div>
+                );
+              })}
             </div>
           </div>
         )}
@@ -298,7 +396,7 @@ function ControlPanel({ instructionCount, setInstructionCount, generateInstructi
 }
 
 // Panel for Play/Pause/Slider
-function PlaybackControls({ isPlaying, setIsPlaying, currentCycle, setCurrentCycle, simulationData }) {
+function PlaybackControls({ isPlaying, setIsPlaying, currentCycle, setCurrentCycle, simulationData, cycleData, series }) {
   return (
     <div className="bg-gray-800/50 backdrop-blur-sm rounded-xl p-6 border border-gray-700">
       <div className="flex items-center justify-between">
@@ -311,7 +409,7 @@ function PlaybackControls({ isPlaying, setIsPlaying, currentCycle, setCurrentCyc
           </button>
           
           <button
-            onClick={() => setCurrentCycle(Math.min(currentCycle + 1, simulationData.cycles.length - 1))}
+            onClick={() => setCurrentCycle(Math.min(currentCycle + 1, simulationData.cycleCount - 1))}
             className="bg-gray-700 hover:bg-gray-600 p-3 rounded-lg transition"
             title="Next Cycle"
           >
@@ -328,8 +426,13 @@ function PlaybackControls({ isPlaying, setIsPlaying, currentCycle, setCurrentCyc
         </div>
 
         <div className="text-right">
-          <div className="text-2xl font-bold">Cycle {simulationData?.cycles[currentCycle]?.cycle || 0}</div>
-          <div className="text-sm text-gray-400">of {simulationData.cycles.length - 1}</div>
+          <div className="text-2xl font-bold">Cycle {cycleData?.cycle || 0}</div>
+          <div className="text-sm text-gray-400">of {simulationData.cycleCount - 1}</div>
+          {series && currentCycle < series.inFlight.length && (
+            <div className="text-xs text-gray-500">
+              {series.inFlight[currentCycle]} in flight · {series.stalls[currentCycle]} stalled
+            </div>
+          )}
         </div>
       </div>
 
@@ -337,7 +440,7 @@ function PlaybackControls({ isPlaying, setIsPlaying, currentCycle, setCurrentCyc
         <input
           type="range"
           min="0"
-          max={simulationData.cycles.length - 1}
+          max={simulationData.cycleCount - 1}
           value={currentCycle}
           onChange={(e) => setCurrentCycle(parseInt(e.target.value))}
           className="w-full h-2 bg-gray-700 rounded-lg appearance-none cursor-pointer range-thumb-purple"
@@ -348,22 +451,15 @@ function PlaybackControls({ isPlaying, setIsPlaying, currentCycle, setCurrentCyc
 }
 
 // Panel for the main pipeline stage display
-function PipelineStagesDisplay({ cycleData }) {
-  const stageColors = {
-    FETCH: 'bg-blue-500',
-    DECODE: 'bg-purple-500',
-    ISSUE: 'bg-yellow-500',
-    EXECUTE: 'bg-green-500',
-    WRITEBACK: 'bg-red-500'
-  };
-
+// `stages` comes from the simulator's machine config (e.g. with REGREAD/COMMIT)
+function PipelineStagesDisplay({ cycleData, stages = DEFAULT_STAGES }) {
   return (
     <div className="bg-gray-800/50 backdrop-blur-sm rounded-xl p-6 border border-gray-700">
       <h2 className="text-2xl font-bold mb-6">Pipeline Stages</h2>
       <div className="space-y-4">
-        {['FETCH', 'DECODE', 'ISSUE', 'EXECUTE', 'WRITEBACK'].map((stage) => (
+        {stages.map((stage) => (
           <div key={stage} className="flex flex-col sm:flex-row sm:items-center gap-4">
-            <div className={`${stageColors[stage]} px-4 py-2 rounded-lg font-semibold w-full sm:w-32 text-center`}>
+            <div className={`${STAGE_COLORS[stage]} px-4 py-2 rounded-lg font-semibold w-full sm:w-32 text-center`}>
               {stage}
             </div>
             <div className="flex-1 bg-gray-700/50 rounded-lg p-3 min-h-14 flex items-center gap-2 flex-wrap">
@@ -371,7 +467,7 @@ function PipelineStagesDisplay({ cycleData }) {
                 cycleData.stages[stage].map((instr, i) => (
                   <div
                     key={i}
-                    className={`${stageColors[stage]} px-3 py-1 rounded-md text-sm font-mono animate-pulse`}
+                    className={`${STAGE_COLORS[stage]} px-3 py-1 rounded-md text-sm font-mono animate-pulse`}
                   >
                     {instr}
                   </div>
@@ -387,6 +483,89 @@ function PipelineStagesDisplay({ cycleData }) {
   );
 }
 
+// Panel for the run's timeline, read from the server's level-of-detail
+// summary: one bar per bucket of cycles, stacked by average stage
+// occupancy. Zooming refetches the range at the matching level, so a
+// long run never sends more than TIMELINE_BUCKETS bars. Click a bar to
+// jump to its first cycle.
+function TimelineOverview({ apiUrl, timelineId, totalCycles, currentCycle, setCurrentCycle }) {
+  const [range, setRange] = useState({ from: 1, to: totalCycles });
+  const [view, setView] = useState(null);
+
+  useEffect(() => {
+    setRange({ from: 1, to: totalCycles });
+  }, [timelineId, totalCycles]);
+
+  useEffect(() => {
+    let cancelled = false;
+    const params = new URLSearchParams({ from: range.from, to: range.to, maxBuckets: TIMELINE_BUCKETS });
+    fetch(`${apiUrl}/api/timeline/${timelineId}?${params}`)
+      .then(response => (response.ok ? response.json() : null))
+      .then(data => { if (!cancelled) setView(data); })
+      .catch(() => { if (!cancelled) setView(null); });
+    return () => { cancelled = true; };
+  }, [apiUrl, timelineId, range]);
+
+  if (!view || view.buckets.length === 0) return null;
+
+  const cycle = currentCycle + 1; // cycles[0] is cycle 1
+  const zoom = (factor) => {
+    const span = Math.min(totalCycles, Math.max(1, Math.round((range.to - range.from + 1) * factor)));
+    const from = Math.max(1, Math.min(cycle - Math.floor(span / 2), totalCycles - span + 1));
+    setRange({ from, to: from + span - 1 });
+  };
+  const sum = (values) => values.reduce((a, b) => a + b, 0);
+  const peak = Math.max(1, ...view.buckets.map(b => sum(b.occupancy) / b.cycles));
+  const describe = (b) => {
+    const units = view.units.map((unit, k) => `${unit} ${Math.round(100 * b.busy[k] / b.cycles)}%`).join(', ');
+    const stalls = view.stallReasons.map((reason, r) => b.stalls[r] > 0 ? `${reason}: ${b.stalls[r]}` : null)
+      .filter(Boolean).join(', ');
+    return `Cycles ${b.cycle}-${b.cycle + b.cycles - 1}\n` +
+           `In flight: ${(sum(b.occupancy) / b.cycles).toFixed(1)} avg\n` +
+           `Stalls: ${stalls || 'none'}\nBusy: ${units}`;
+  };
+
+  return (
+    <div className="bg-gray-800/50 backdrop-blur-sm rounded-xl p-6 border border-gray-700">
+      <div className="flex flex-col sm:flex-row sm:items-center justify-between gap-2 mb-4">
+        <h3 className="text-xl font-bold">Timeline</h3>
+        <div className="flex items-center gap-2">
+          <span className="text-sm text-gray-400 mr-2">
+            Cycles {view.from}-{view.to} · {view.cyclesPerBucket} per bar
+          </span>
+          <button onClick={() => zoom(0.25)} className="bg-gray-700 hover:bg-gray-600 p-2 rounded-lg transition" title="Zoom in">
+            <ZoomIn className="w-4 h-4" />
+          </button>
+          <button onClick={() => zoom(4)} className="bg-gray-700 hover:bg-gray-600 p-2 rounded-lg transition" title="Zoom out">
+            <ZoomOut className="w-4 h-4" />
+          </button>
+          <button onClick={() => setRange({ from: 1, to: totalCycles })} className="bg-gray-700 hover:bg-gray-600 p-2 rounded-lg transition" title="Whole run">
+            <Maximize2 className="w-4 h-4" />
+          </button>
+        </div>
+      </div>
+      <div className="flex items-end gap-px h-32">
+        {view.buckets.map((b) => (
+          <div
+            key={b.cycle}
+            onClick={() => setCurrentCycle(Math.min(b.cycle - 1, totalCycles - 1))}
+            title={describe(b)}
+            className={`flex-1 h-full flex flex-col-reverse cursor-pointer hover:opacity-80 ${cycle >= b.cycle && cycle < b.cycle + b.cycles ? 'bg-white/20' : ''}`}
+          >
+            {view.stages.map((stage, s) => (
+              <div
+                key={stage}
+                className={STAGE_COLORS[stage]}
+                style={{ height: `${100 * b.occupancy[s] / b.cycles / peak}%` }}
+              />
+            ))}
+          </div>
+        ))}
+      </div>
+    </div>
+  );
+}
+
 // Panel for Stalls
 function StallsDisplay({ stalls }) {
   return (
@@ -426,6 +605,20 @@ function StatsSummary({ simulationData }) {
           <div className="text-sm text-red-300 mb-1">Total Stalls</div>
           <div className="text-3xl font-bold">{simulationData.stats.totalStalls}</div>
         </div>
+
+        {simulationData.derived && (
+          <div className="text-sm text-gray-400 space-y-1">
+            <div>
+              In flight: {simulationData.derived.averageInFlight.toFixed(1)} avg, {simulationData.derived.peakInFlight} peak
+            </div>
+            {simulationData.derived.stallReasons.slice(0, 3).map(({ reason, count }) => (
+              <div key={reason} className="flex justify-between gap-2">
+                <span className="truncate">{reason}</span>
+                <span className="font-mono">{count}</span>
+              </div>
+            ))}
+          </div>
+        )}
       </div>
     </div>
   );
@@ -0,0 +1,132 @@
+// Web Worker that owns a simulation result so the page never parses or
+// holds the per-cycle history on the main thread.
+//
+// Requests are { id, type, ... } and each gets one reply { id, result }
+// or { id, error }:
+//   load   { buffer, contentType, instructions } decodes the /api/simulate
+//          response body (transferred, not copied) and replies with the
+//          run summary, the instruction index and per-cycle series; the
+//          typed arrays are transferred back.
+//   cycle  { index } replies with one entry of the cycle history.
+
+let cycles = [];
+
+// The simulator answers with JSON; a binary encoding would be decoded
+// here, keyed on the response's Content-Type.
+function decodeResult(buffer, contentType) {
+  if (contentType && !contentType.includes('json')) {
+    throw new Error(`Unsupported result encoding ${contentType}`);
+  }
+  const data = JSON.parse(new TextDecoder().decode(buffer));
+  if (!data.result || !data.result.cycles) {
+    throw new Error('Invalid simulation data received');
+  }
+  return data.result;
+}
+
+// RAW reasons name the register and writer; they are grouped as "RAW",
+// as in the simulator's timeline summary.
+function stallCategory(reason) {
+  return reason.startsWith('RAW') ? 'RAW' : (reason || 'Other');
+}
+
+// Instruction text -> first and last cycle it is in flight and the
+// cycles it spends stalled (repeated lines of a trace share an entry),
+// plus the in-flight and stalled counts of every cycle.
+function buildIndex(history, stages, instructions) {
+  const rows = new Map();
+  const first = [];
+  const last = [];
+  const stalled = [];
+  const row = (text) => {
+    let r = rows.get(text);
+    if (r === undefined) {
+      r = rows.size;
+      rows.set(text, r);
+      first.push(-1);
+      last.push(-1);
+      stalled.push(0);
+    }
+    return r;
+  };
+  const inFlight = new Uint32Array(history.length);
+  const stallCount = new Uint32Array(history.length);
+  const stallReasons = new Map();
+
+  history.forEach((cycle, c) => {
+    for (const stage of stages) {
+      const entries = cycle.stages[stage] || [];
+      inFlight[c] += entries.length;
+      for (const text of entries) {
+        const r = row(text);
+        if (first[r] < 0) first[r] = c;
+        last[r] = c;
+      }
+    }
+    for (const stall of cycle.stalls || []) {
+      stalled[row(stall.instruction)]++;
+      const category = stallCategory(stall.reason);
+      stallReasons.set(category, (stallReasons.get(category) || 0) + 1);
+    }
+    stallCount[c] = (cycle.stalls || []).length;
+  });
+
+  const lineRow = new Int32Array(instructions.length);
+  instructions.forEach((text, i) => {
+    const r = rows.get(text) ?? rows.get(text.trim());
+    lineRow[i] = r === undefined ? -1 : r;
+  });
+
+  let peak = 0;
+  let total = 0;
+  for (const n of inFlight) {
+    peak = Math.max(peak, n);
+    total += n;
+  }
+  return {
+    index: {
+      lineRow,
+      firstCycle: Int32Array.from(first),
+      lastCycle: Int32Array.from(last),
+      stalledCycles: Int32Array.from(stalled),
+    },
+    series: { inFlight, stalls: stallCount },
+    derived: {
+      peakInFlight: peak,
+      averageInFlight: history.length ? total / history.length : 0,
+      stallReasons: [...stallReasons.entries()]
+        .map(([reason, count]) => ({ reason, count }))
+        .sort((a, b) => b.count - a.count),
+    },
+  };
+}
+
+function load({ buffer, contentType, instructions = [] }) {
+  const result = decodeResult(buffer, contentType);
+  cycles = result.cycles;
+  const stages = result.stages || Object.keys(cycles[0]?.stages || {});
+  const { index, series, derived } = buildIndex(cycles, stages, instructions);
+  const summary = { ...result };
+  delete summary.cycles;
+  summary.cycleCount = cycles.length;
+  summary.derived = derived;
+  const transfer = [index.lineRow, index.firstCycle, index.lastCycle, index.stalledCycles,
+                    series.inFlight, series.stalls].map(array => array.buffer);
+  return { result: { summary, index, series }, transfer };
+}
+
+self.onmessage = ({ data }) => {
+  const { id, type } = data;
+  try {
+    if (type === 'load') {
+      const { result, transfer } = load(data);
+      self.postMessage({ id, result }, transfer);
+    } else if (type === 'cycle') {
+      self.postMessage({ id, result: cycles[data.index] || null });
+    } else {
+      throw new Error(`Unknown request ${type}`);
+    }
+  } catch (err) {
+    self.postMessage({ id, error: err.message });
+  }
+};